@@ -12,23 +12,29 @@
 
 #include "analyzer.h"
 #include "config.h"
+#include "container.h"
+#include "follow.h"
 #include "parser.h"
 #include "symtable.h"
+#include "workqueue.h"
 
 #include "cxxopts/cxxopts.hpp"
-#include "dtl/dtl.hpp"
 #include <assert.h>
 #include <errno.h>
+#include <glob.h>
 #include <regex>
 #include <ctime>
+#include <chrono>
+#include <csignal>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <string>
 #include <cstring>
 #include <cstdlib>
-
-using dtl::Diff;
-using dtl::elemInfo;
-using dtl::uniHunk;
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
@@ -38,14 +44,26 @@ cxxopts::Options add_options() {
   cxxopts::Options options("Log analyzer", "Analyze the log of s2e result");
 
   options.add_options()
-      ("i,input", "input file name", cxxopts::value<string>())
-      ("c,constraint", "constraint file name", cxxopts::value<string>())
+      ("i,input", "input file names or glob patterns (comma separated or repeated)", cxxopts::value<vector<string>>())
+      ("c,constraint", "constraint file names or glob patterns, one per input", cxxopts::value<vector<string>>())
       ("e,executable", "path to the executable file", cxxopts::value<string>())
       ("s,symtable", "path to symbol table file of executable (produced from objdump)", cxxopts::value<string>())
       ("o,output", "output file name", cxxopts::value<string>())
       ("d,outdir", "output directory", cxxopts::value<string>())
       ("append", "append to output file", cxxopts::value<bool>())
       ("n,number","max number constraints ignored",cxxopts::value<int>())
+      ("j,jobs", "number of worker threads", cxxopts::value<int>())
+      ("f,follow", "keep analyzing the input while it is being written", cxxopts::value<bool>())
+      ("convert", "convert the input to an indexed trace container at this path and exit", cxxopts::value<string>())
+      ("compress", "compress the trace records of the converted container", cxxopts::value<bool>())
+      ("symbol-cache", "directory of the symbol table cache (default: the output directory)", cxxopts::value<string>())
+      ("maps", "a /proc/pid/maps snapshot of the traced process, to resolve addresses in shared libraries", cxxopts::value<string>())
+      ("load-base", "address the executable is loaded at, for position independent executables", cxxopts::value<string>())
+      ("memory-budget", "keep at most this many MB of traces in memory during the analysis, spilling the rest to a scratch file", cxxopts::value<int>())
+      ("states", "only load these states from a trace container (comma separated)", cxxopts::value<vector<int>>())
+      ("diff-engine", "how traces are diffed: myers (in process, default), lcs (in process, bit-parallel), tree (in process, along the call trees) or gnu (diff -u)", cxxopts::value<string>())
+      ("tree-diff-threshold", "with --diff-engine tree, only trim the subtrees of calls whose execution times differ by less than this many ms", cxxopts::value<double>())
+      ("follow-timeout", "stop following after the input has not grown for this many seconds", cxxopts::value<int>())
       ("help", "Print help message");
 
   return options;
@@ -56,6 +74,23 @@ inline bool file_exists(const string &name) {
   return f.good();
 }
 
+// Expand the glob patterns in paths. A pattern without a match is kept
+// as is, so that a missing file is reported by name.
+static vector<string> expand_paths(const vector<string> &paths) {
+  vector<string> result;
+  for (auto pit = paths.begin(); pit != paths.end(); ++pit) {
+    glob_t matches;
+    if (glob(pit->c_str(), 0, NULL, &matches) == 0) {
+      for (size_t i = 0; i < matches.gl_pathc; ++i)
+        result.push_back(matches.gl_pathv[i]);
+    } else {
+      result.push_back(*pit);
+    }
+    globfree(&matches);
+  }
+  return result;
+}
+
 int parse_options(int argc, char **argv) {
   auto options = add_options();
   try {
@@ -67,7 +102,7 @@ int parse_options(int argc, char **argv) {
     if (!result.count("input")) {
       throw cxxopts::option_required_exception("input");
     }
-    if (!result.count("output")) {
+    if (!result.count("output") && !result.count("convert")) {
       throw cxxopts::option_required_exception("output");
     }
     if (result.count("outdir")) {
@@ -81,10 +116,26 @@ int parse_options(int argc, char **argv) {
     } else {
       config.max_ignored = 0;
     }
-    config.input_path = result["input"].as<string>();
-    config.output_path = result["output"].as<string>();
+    if (result.count("jobs")) {
+      config.jobs = result["jobs"].as<int>() < 1 ? 1 : result["jobs"].as<int>();
+    } else {
+      config.jobs = 1;
+    }
+    config.input_paths = expand_paths(result["input"].as<vector<string>>());
+    config.input_path = config.input_paths[0];
+    if (result.count("output")) {
+      config.output_path = result["output"].as<string>();
+    }
     if (result.count("constraint")) {
-      config.constraint_path = result["constraint"].as<string>();
+      config.constraint_paths = expand_paths(result["constraint"].as<vector<string>>());
+      if (config.constraint_paths.size() != config.input_paths.size()) {
+        cerr << "Got " << config.constraint_paths.size() << " constraint files for "
+          << config.input_paths.size() << " inputs" << endl;
+        return -1;
+      }
+      config.constraint_path = config.constraint_paths[0];
+    } else {
+      config.constraint_paths.resize(config.input_paths.size());
     }
     if (result.count("executable")) {
       config.executable_path = result["executable"].as<string>();
@@ -93,9 +144,74 @@ int parse_options(int argc, char **argv) {
       config.symtable_path = result["symtable"].as<string>();
     }
     config.append_output = result["append"].as<bool>();
-    if (!file_exists(config.input_path)) {
-      cerr << "Input file " << config.input_path
-                << "does not exist" << endl;
+    config.follow = result["follow"].as<bool>();
+    if (result.count("convert")) {
+      config.convert_path = result["convert"].as<string>();
+    }
+    config.compress = result["compress"].as<bool>();
+    if (result.count("states")) {
+      const vector<int> &states = result["states"].as<vector<int>>();
+      config.states.insert(states.begin(), states.end());
+    }
+    if (result.count("symbol-cache")) {
+      config.symcache_dir = result["symbol-cache"].as<string>();
+    }
+    if (result.count("maps")) {
+      config.maps_path = result["maps"].as<string>();
+    }
+    if (result.count("load-base")) {
+      const string &base = result["load-base"].as<string>();
+      char *end;
+      errno = 0;
+      config.load_base = strtoull(base.c_str(), &end, 16);
+      if (base.empty() || *end != '\0' || errno != 0 || base[0] == '-') {
+        cerr << "Invalid load base " << base << ", expected a hex address" << endl;
+        return -1;
+      }
+    } else {
+      config.load_base = 0;
+    }
+    if (result.count("memory-budget")) {
+      config.memory_budget = result["memory-budget"].as<int>() < 0 ? 0 : result["memory-budget"].as<int>();
+    } else {
+      config.memory_budget = 0;
+    }
+    config.diff_engine = DIFF_ENGINE_MYERS;
+    if (result.count("diff-engine") && 
+        !parse_diff_engine(result["diff-engine"].as<string>(), &config.diff_engine)) {
+      cerr << "Unknown diff engine " << result["diff-engine"].as<string>() << endl;
+      return -1;
+    }
+    if (result.count("tree-diff-threshold")) {
+      config.tree_diff_threshold = result["tree-diff-threshold"].as<double>();
+    } else {
+      config.tree_diff_threshold = 0;
+    }
+    if (result.count("follow-timeout")) {
+      config.follow_timeout = result["follow-timeout"].as<int>();
+    } else {
+      config.follow_timeout = 0;
+    }
+    for (auto iit = config.input_paths.begin(); iit != config.input_paths.end(); ++iit) {
+      if (!file_exists(*iit)) {
+        cerr << "Input file " << *iit << " does not exist" << endl;
+        return -1;
+      }
+    }
+    if (config.follow && config.input_paths.size() > 1) {
+      cerr << "Only a single input can be followed" << endl;
+      return -1;
+    }
+    if (config.follow && config.memory_budget > 0) {
+      cerr << "--memory-budget cannot be used with --follow" << endl;
+      return -1;
+    }
+    if (config.follow && !config.convert_path.empty()) {
+      cerr << "--convert cannot be used with --follow" << endl;
+      return -1;
+    }
+    if (!config.convert_path.empty() && config.memory_budget > 0) {
+      cerr << "--memory-budget cannot be used with --convert" << endl;
       return -1;
     }
     return 0;
@@ -109,7 +225,9 @@ int parse_options(int argc, char **argv) {
 VioletTraceAnalyzer::VioletTraceAnalyzer(const char* log_path, const char* outdir, 
     const char* output_path, const char* symtab_path, const char* executable_path, 
     bool append_output, int max_ignored):
-    log_path_(log_path), out_path_(output_path), max_ignored_(max_ignored)
+    log_path_(log_path), out_path_(output_path), max_ignored_(max_ignored),
+    memory_budget_(0), follow_mode_(false), result_base_(0), jobs_(1), diff_engine_(DIFF_ENGINE_MYERS), tree_diff_threshold_(0),
+    black_list_address_(0), black_list_id_(INVALID_ADDRESS_ID), spill_store_(NULL)
 {
   if (outdir != NULL) {
     out_dir_ = outdir; 
@@ -121,22 +239,85 @@ VioletTraceAnalyzer::VioletTraceAnalyzer(const char* log_path, const char* outdi
   if (executable_path != NULL)
     executable_path_ = executable_path;
   analysis_log_.open(log_path);
+  struct stat st;
+  if (append_output && stat(output_path, &st) == 0)
+    result_base_ = st.st_size;
   if (append_output)
     result_file_.open(output_path, fstream::app);
   else
     result_file_.open(output_path);
 }
 
-bool VioletTraceAnalyzer::init()
+// Create the output directory unless it exists
+static bool make_directory(const string &dir)
 {
-  int ret = mkdir(out_dir_.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+  int ret = mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
   if (ret != 0) {
     if (errno != EEXIST) {// ignore dir exists error
       perror("Error in creating output directory");
       return false;
     }
   }
+  return true;
+}
+
+bool VioletTraceAnalyzer::init()
+{
+  if (!make_directory(out_dir_))
+    return false;
+  if (!load_symbols())
+    return false;
+  if (maps_path_.size() > 0) {
+    string cache_dir = symcache_dir_.empty() ? out_dir_ : symcache_dir_;
+    analysis_log_ << "Loading the modules in " << maps_path_ << "...";
+    bool success = module_map_.load(maps_path_, jobs_, cache_dir);
+    analysis_log_ << (success ? "Succeeded" : "Failed") << endl;
+    if (!success)
+      return false;
+    for (size_t i = 0; i < module_map_.size(); ++i) {
+      const Module &module = module_map_.module(i);
+      analysis_log_ << "module " << module.path << " at " << hexval(module.start) 
+        << "-" << hexval(module.end) << ", " << module.symbols->size() << " symbols" << endl;
+    }
+    cout << "Successfully loaded " << module_map_.size() << " modules from " 
+      << maps_path_ << endl;
+  }
+  return true;
+}
+
+bool VioletTraceAnalyzer::load_symbols()
+{
+  string source = executable_path_.size() > 0 ? executable_path_ : symtab_path_;
+  if (source.empty())
+    return true;
+  string cache_dir = symcache_dir_.empty() ? out_dir_ : symcache_dir_;
+  string cache_file = cache_dir + "/" + SymbolTable::cache_file_name(source);
+  string cache_key = SymbolTable::cache_key(source);
+  if (!cache_key.empty() && SymbolTable::load_cache(cache_file, cache_key, &symbol_table_)) {
+    analysis_log_ << "Loaded symbol table for " << source << " from " << cache_file << endl;
+    cout << "Successfully loaded " << symbol_table_.size() << " symbols from " 
+      << cache_file << endl;
+    return true;
+  }
+  if (!parse_symbols())
+    return false;
+  if (!cache_key.empty() && symbol_table_.save_cache(cache_file, cache_key))
+    analysis_log_ << "Saved symbol table to " << cache_file << endl;
+  return true;
+}
+
+bool VioletTraceAnalyzer::parse_symbols()
+{
   if (executable_path_.size() > 0) {
+    analysis_log_ << "Reading symbol table from executable " << executable_path_ << "...";
+    if (SymbolTable::parse_elf(executable_path_, &symbol_table_)) {
+      analysis_log_ << "Succeeded" << endl;
+      cout << "Successfully read " << symbol_table_.size() << " symbols from " 
+        << executable_path_ << endl;
+      return true;
+    }
+    analysis_log_ << "Failed" << endl;
+    // not an ELF64 executable we can read, let objdump have a go at it
     string filename = executable_path_.substr(executable_path_.find_last_of('/') + 1);
     symtab_path_ = out_dir_ + "/" + filename.substr(0, filename.find_last_of('.')) + ".sym";
     string objdump_cmd = "objdump -C -t " + executable_path_ + " > " + symtab_path_;
@@ -150,7 +331,7 @@ bool VioletTraceAnalyzer::init()
   }
   if (symtab_path_.size() > 0) {
     analysis_log_ << "Parsing symbol table for executable from " << symtab_path_ << "...";
-    bool success = SymbolTable::parse(symtab_path_, &symbol_table_);
+    bool success = SymbolTable::parse(symtab_path_, &symbol_table_, jobs_);
     analysis_log_ << (success ? "Succeeded" : "Failed") << endl;
     if (success) {
       cout << "Successfully parsed " << symbol_table_.size() << " symbols from " 
@@ -177,150 +358,512 @@ void VioletTraceAnalyzer::build_black_list() {
 
   struct obj_symbol *badFunction = symbol_table_.get_symbol_by_func(black_function);
   if(badFunction)
-    black_list = badFunction->saddress;
+    black_list_address_ = badFunction->address;
 }
 
 
 
 void VioletTraceAnalyzer::analyze_cost_table(StateCostTable *cost_table) {
-  double latency_diff_percent_threshold = 0.2;
-  int n = max_ignored_; // # of parameters skipped
+  analyze_states(cost_table, NULL);
+  finish_analysis(cost_table);
+}
 
-  // diff of any pair-wise records in the cost table
+void VioletTraceAnalyzer::write_trace_file(const StateCostRecord *record)
+{
+  ofstream trace_file(get_trace_file_name(record->id));
+  trace_file << FunctionTraceItem::csv_header() << endl;
+  const FunctionTrace &trace = record->trace;
+  for (size_t idx = 0; idx < trace.size(); ++idx) {
+    trace_file << trace[idx].to_csv() << endl;
+  }
+  trace_file.close();
+}
+
+void VioletTraceAnalyzer::analyze_states(StateCostTable *cost_table,
+    const std::set<int> *changed_states) {
+  // comparisons work on the function ids, which also lets the black list
+  // be checked without formatting any address
+  cost_table->intern_functions();
+  black_list_id_ = black_list_address_ == 0 ? INVALID_ADDRESS_ID :
+    cost_table->functions().find(black_list_address_);
+  // the traces of changed states have new call trees
+  tree_diff_cache_.clear();
+
+  if (memory_budget_ > 0 && changed_states == NULL && 
+      analyze_states_out_of_core(cost_table))
+    return;
+
+  // in follow mode, the call trees of unchanged states are kept
+  vector<StateCostRecord *> grown;
+  for (StateCostTable::iterator it = cost_table->begin(); it != cost_table->end(); ++it) {
+    if (changed_states == NULL || changed_states->count(it->id) || 
+        call_trees_.find(&*it) == call_trees_.end())
+      grown.push_back(&*it);
+  }
+  build_call_trees(grown);
+
+  // diff of any pair-wise records in the cost table. If changed_states is
+  // given, only the pairs that involve at least one changed state are diffed.
+  vector<PairTask> tasks;
   for (StateCostTable::iterator it = cost_table->begin(); it != cost_table->end(); ++it) {
-    ofstream trace_file(get_trace_file_name(it->first));
-    trace_file << FunctionTraceItem::csv_header() << endl;
-    for (FunctionTrace::iterator fit = it->second.trace.begin(); fit != it->second.trace.end(); ++fit) {
-      trace_file << fit->to_csv() << endl;
+    bool first_changed = changed_states == NULL || changed_states->count(it->id);
+    if (first_changed) {
+      tasks.push_back(PairTask(&*it, NULL));
     }
-    trace_file.close();
     StateCostTable::iterator jt = it;
     for (++jt; jt != cost_table->end(); ++jt) {
-      StateCostRecord *first_record = &it->second;
-      StateCostRecord *second_record = &jt->second;
-      bool is_comparable = true;
-      ConstraintTrace first_constraints = first_record->constraints;
-      ConstraintTrace second_constraints = second_record->constraints;
-      if(first_record->constraints.size() != second_record->constraints.size()) {
-        analysis_log_ << "state " << it->first << "'is not comparable with" <<
-          " state " << jt->first << endl;
+      if (!first_changed && !changed_states->count(jt->id))
         continue;
+      tasks.push_back(PairTask(&*it, &*jt));
+    }
+  }
+  run_pairs(tasks);
+  if (follow_mode_)
+    rewrite_result();
+  else
+    call_trees_.clear();
+}
+
+void VioletTraceAnalyzer::build_call_trees(const vector<StateCostRecord *> &records)
+{
+  if (diff_engine_ != DIFF_ENGINE_TREE)
+    return;
+  vector<CallTree *> trees;
+  for (size_t i = 0; i < records.size(); ++i) {
+    unique_ptr<CallTree> &tree = call_trees_[records[i]];
+    if (!tree)
+      tree.reset(new CallTree());
+    trees.push_back(tree.get());
+  }
+  // the trees are independent, so they are built in parallel
+  atomic<size_t> next(0);
+  auto build_trees = [&]() {
+    for (size_t i = next++; i < records.size(); i = next++)
+      trees[i]->build(records[i]->trace);
+  };
+  size_t worker_cnt = min(records.size(), (size_t) max(jobs_, 1));
+  vector<thread> workers;
+  for (size_t w = 1; w < worker_cnt; ++w)
+    workers.push_back(thread(build_trees));
+  build_trees();
+  for (size_t w = 0; w < workers.size(); ++w)
+    workers[w].join();
+}
+
+void VioletTraceAnalyzer::run_pairs(const vector<PairTask> &tasks)
+{
+  // the external diff writes a key file per state, which pairs sharing
+  // a state would write at the same time
+  size_t workers = diff_engine_ == DIFF_ENGINE_GNU ? 1 :
+    min((size_t) max(jobs_, 1), tasks.size());
+  if (workers <= 1) {
+    for (size_t k = 0; k < tasks.size(); ++k) {
+      PairResult result;
+      if (tasks[k].second != NULL)
+        compare_states(tasks[k].first, tasks[k].second, &result);
+      commit_pair(tasks[k], &result);
+    }
+    return;
+  }
+
+  vector<unique_ptr<PairResult> > results(tasks.size());
+  mutex results_mutex;
+  condition_variable results_ready, results_merged;
+  size_t merged = 0;
+  WorkStealingQueue queue(tasks.size(), workers);
+  auto work = [&](size_t worker) {
+    size_t k;
+    while (queue.pop(worker, &k)) {
+      {
+        // bound the results waiting to be merged
+        unique_lock<mutex> lock(results_mutex);
+        results_merged.wait(lock, [&merged, k, workers] { 
+          return k < merged + PAIR_RESULT_WINDOW(workers); 
+        });
+      }
+      unique_ptr<PairResult> result(new PairResult());
+      if (tasks[k].second != NULL)
+        compare_states(tasks[k].first, tasks[k].second, result.get());
+      lock_guard<mutex> lock(results_mutex);
+      results[k] = move(result);
+      results_ready.notify_one();
+    }
+  };
+  vector<thread> threads;
+  for (size_t w = 0; w < workers; ++w)
+    threads.push_back(thread(work, w));
+
+  // merge the results in task order, as a serial run would produce them
+  for (size_t k = 0; k < tasks.size(); ++k) {
+    unique_ptr<PairResult> result;
+    {
+      unique_lock<mutex> lock(results_mutex);
+      results_ready.wait(lock, [&results, k] { return results[k] != nullptr; });
+      result = move(results[k]);
+    }
+    commit_pair(tasks[k], result.get());
+    result.reset();
+    {
+      lock_guard<mutex> lock(results_mutex);
+      merged = k + 1;
+    }
+    results_merged.notify_all();
+  }
+  for (auto tit = threads.begin(); tit != threads.end(); ++tit)
+    tit->join();
+}
+
+void VioletTraceAnalyzer::commit_pair(const PairTask &task, PairResult *result)
+{
+  if (task.second == NULL) {
+    write_trace_file(task.first);
+    return;
+  }
+  analysis_log_ << result->log.str();
+  if (result->diffed != NULL) {
+    result->diffed->trace.swap_diff_latencies(result->diff_latency);
+    if (spill_store_ != NULL && spill_store_->is_open())
+      spill_store_->mark_dirty(result->diffed);
+    if (!follow_mode_)
+      write_critical_path(result_file_, result->diffed->id, result->base_id, 
+          result->critical_path);
+  }
+  if (follow_mode_) {
+    // the pair may no longer have a critical path at all
+    pair<int, int> key(min(task.first->id, task.second->id), 
+        max(task.first->id, task.second->id));
+    latest_paths_.erase(key);
+    if (result->diffed != NULL) {
+      ostringstream block;
+      write_critical_path(block, result->diffed->id, result->base_id, 
+          result->critical_path);
+      latest_paths_[key] = block.str();
+    }
+  }
+  cout << result->console.str();
+}
+
+void VioletTraceAnalyzer::rewrite_result()
+{
+  result_file_.close();
+  if (truncate(out_path_.c_str(), result_base_) != 0)
+    perror("Error in truncating the result file");
+  result_file_.open(out_path_, fstream::app);
+  for (auto pit = latest_paths_.begin(); pit != latest_paths_.end(); ++pit)
+    result_file_ << pit->second;
+  result_file_.flush();
+}
+
+bool VioletTraceAnalyzer::analyze_states_out_of_core(StateCostTable *cost_table)
+{
+  if (spill_store_ == NULL || !spill_store_->is_open())
+    return false;
+  vector<StateCostRecord *> records;
+  vector<size_t> footprints;
+  size_t total_bytes = 0, max_items = 0;
+  for (StateCostTable::iterator it = cost_table->begin(); it != cost_table->end(); ++it) {
+    // the traces may have been spilled while parsing
+    size_t items = spill_store_->trace_size(&*it);
+    records.push_back(&*it);
+    footprints.push_back(items * (SPILL_ITEM_BYTES + 
+          (diff_engine_ == DIFF_ENGINE_TREE ? CALL_TREE_NODE_BYTES : 0)));
+    total_bytes += footprints.back();
+    max_items = max(max_items, items);
+  }
+  // the diff latencies of the pairs being compared, but not yet merged
+  size_t reserve_bytes = PAIR_RESULT_WINDOW(max(jobs_, 1)) * max_items * sizeof(double);
+  if (total_bytes + reserve_bytes <= memory_budget_) {
+    for (size_t i = 0; i < records.size(); ++i) {
+      if (!spill_store_->load(records[i], cost_table->functions())) {
+        cerr << "Abort: failed to page traces in from the scratch file" << endl;
+        exit(1);
       }
+    }
+    return false;
+  }
+  size_t tile_budget = reserve_bytes < memory_budget_ ? 
+    (memory_budget_ - reserve_bytes) / 2 : 0;
+
+  // Group the states into tiles of at most half the budget left, so that
+  // the two tiles of a tile pair fit in memory together. A state larger
+  // than that gets a tile of its own.
+  vector<size_t> tiles;
+  size_t tile_bytes = 0;
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (i == 0 || tile_bytes + footprints[i] > tile_budget) {
+      tiles.push_back(i);
+      tile_bytes = 0;
+    }
+    tile_bytes += footprints[i];
+  }
+  size_t tile_cnt = tiles.size();
+  tiles.push_back(records.size());
+  analysis_log_ << "traces take " << total_bytes << " bytes, over the memory budget of "
+    << memory_budget_ << " bytes; analyzing " << records.size() << " states in " 
+    << tile_cnt << " tiles" << endl;
+
+  // start with no trace in memory, whether it was spilled while parsing
+  // or not
+  bool success = true;
+  for (size_t i = 0; i < records.size() && success; ++i) {
+    if (spill_store_->is_resident(records[i]) && !spill_store_->evict(records[i]))
+      success = false;
+  }
 
-      ConstraintTrace first_combination, second_combination;
-
-      std::function<void(int, int)> make_comparison = [=, &make_comparison]
-                        (int oft, int k) mutable -> void {
-
-        if (k == 0)
-        {
-          is_comparable = true;
-
-          for (uint i = 0 ; i < first_combination.size(); ++i) {
-            ConstraintItem first_constraint = first_combination[i];
-            ConstraintItem second_constraint = second_combination[i];
-            if (first_constraint.value != second_constraint.value) {
-              analysis_log_ << "state " << it->first << "'is not compareable with" <<
-                            " state " << jt->first << endl;
-              is_comparable = false;
-              break;
-            }
-
-            if(first_constraint.variable_number != second_constraint.variable_number)
-              std::cout << "error\n";
-          }
-
-          if(!is_comparable)
-            return;
-
-
-          // print constraints
-          analysis_log_ <<  "state [" <<  first_record->id <<"]: target constraint = ";
-          if (first_record->target_constraints.size())
-            analysis_log_ << first_record->target_constraints[0].value;
-          else analysis_log_ << "null";
-          analysis_log_ << ", constraints = ";
-          for (auto i = first_constraints.begin(); i != first_constraints.end(); ++i) {
-            analysis_log_ << i->value << " ";
-          }
-          analysis_log_ <<  "\nstate [" <<  second_record->id <<"]: target constraint = ";
-          if (second_record->target_constraints.size())
-            analysis_log_ << second_record->target_constraints[0].value;
-          else analysis_log_ << "null";
-          analysis_log_ << ", constraints = ";
-          for (auto i = second_constraints.begin(); i != second_constraints.end(); ++i) {
-            analysis_log_ << i->value << " ";
-          }
-          analysis_log_ << endl;
-
-
-          if (it->second.execution_time > jt->second.execution_time) {
-            // ensure second_record always has larger execution time
-            analysis_log_ << "state " << it->first << "'s execution time " <<
-                          it->second.execution_time << " > state " << jt->first <<
-                          "'s execution_time " << jt->second.execution_time << endl;
-            first_record = &jt->second;
-            second_record = &it->second;
-          }
-
-          double latency_diff_percent = 1.0 * (second_record->execution_time -
-              first_record->execution_time) / first_record->execution_time;
-          analysis_log_ << "execution time for state " << first_record->id <<
-                        " and state " << second_record->id << " differ by " << latency_diff_percent << endl;
-          if (latency_diff_percent < latency_diff_percent_threshold) {
-            // latencies are similar, skip diff
-            return;
-          }
-
-          analysis_log_ << "comparing cost record for state " << first_record->id <<
-                        " and state " << second_record->id << endl;
-          FunctionTrace diff_trace;
-          // The result from dtl library is buggy: the computed diff trace can have hunk that
-          // is not only unordered but also incorrect w.r.t the original files.
-          // So we we use the gnu_diff_trace instead of dtl_diff_trace
-          gnu_diff_trace(first_record->id, second_record->id, first_record->trace,
-                         second_record->trace, diff_trace);
-          analysis_log_ << "obtained a diff trace of size " << diff_trace.size() << endl;
-          if (compute_diff_latency(first_record->trace, second_record->trace, diff_trace)) {
-            analysis_log_ << "computed the diff latency for " <<
-                          second_record->trace.size() << " trace items " << endl;
-            compute_critical_path(second_record, first_record->id);
-            cout << "Successfully computed the differential critical path for state pair <"
-                 << first_record->id << "," << second_record->id << ">" << endl;
-          }
-
-          return;
+  // Make tiles a and b resident. At most two tiles are kept in memory: 
+  // the wanted ones and, if there is room, the resident tile that comes 
+  // latest, as tiles before a are never wanted again.
+  vector<char> tile_resident(tile_cnt, 0);
+  auto page_in = [&](size_t a, size_t b) -> bool {
+    vector<char> keep(tile_cnt, 0);
+    keep[a] = keep[b] = 1;
+    size_t kept = a == b ? 1 : 2;
+    for (size_t t = tile_cnt; t > a && kept < 2; --t) {
+      if (tile_resident[t - 1] && !keep[t - 1]) {
+        keep[t - 1] = 1;
+        kept++;
+      }
+    }
+    for (size_t t = 0; t < tile_cnt; ++t) {
+      if (!tile_resident[t] || keep[t])
+        continue;
+      for (size_t i = tiles[t]; i < tiles[t + 1]; ++i) {
+        call_trees_.erase(records[i]);
+        if (!spill_store_->evict(records[i]))
+          return false;
+      }
+      tile_resident[t] = 0;
+    }
+    size_t wanted[2] = {a, b};
+    for (size_t w = 0; w < 2; ++w) {
+      size_t t = wanted[w];
+      if (tile_resident[t])
+        continue;
+      for (size_t i = tiles[t]; i < tiles[t + 1]; ++i) {
+        if (!spill_store_->load(records[i], cost_table->functions()))
+          return false;
+      }
+      build_call_trees(vector<StateCostRecord *>(records.begin() + tiles[t], 
+            records.begin() + tiles[t + 1]));
+      tile_resident[t] = 1;
+    }
+    return true;
+  };
+
+  // Tile a stays in memory for its whole row of tile pairs. Each row
+  // starts with the pairs within tile a, where the trace file of each 
+  // state is written between its pairs with earlier and with later 
+  // states, as in a serial run. The other pairs of the row are walked in
+  // alternating directions, so that the last tile of a row is still 
+  // resident at the start of the next one.
+  for (size_t a = 0; a < tile_cnt && success; ++a) {
+    for (size_t step = 0; step < tile_cnt - a; ++step) {
+      size_t b = step == 0 ? a : a % 2 == 0 ? a + step : tile_cnt - step;
+      if (!page_in(a, b)) {
+        success = false;
+        break;
+      }
+      vector<PairTask> tasks;
+      for (size_t i = tiles[a]; i < tiles[a + 1]; ++i) {
+        if (a == b)
+          tasks.push_back(PairTask(records[i], NULL));
+        for (size_t j = max(i + 1, tiles[b]); j < tiles[b + 1]; ++j) {
+          tasks.push_back(PairTask(records[i], records[j]));
         }
+      }
+      run_pairs(tasks);
+    }
+  }
+
+  // the traces stay in the scratch file, the rest of the analysis only 
+  // needs the record metadata
+  call_trees_.clear();
+  analysis_log_ << "spilled " << spill_store_->evictions() << " traces (" << 
+    spill_store_->bytes_written() << " bytes) and reloaded " << spill_store_->loads() << 
+    " traces (" << spill_store_->bytes_read() << " bytes)" << endl;
+  if (!success) {
+    cerr << "Abort: failed to page traces in from the scratch file" << endl;
+    exit(1);
+  }
+  return true;
+}
+
+void VioletTraceAnalyzer::compare_states(StateCostRecord *first_state, 
+    StateCostRecord *second_state, PairResult *result)
+{
+  double latency_diff_percent_threshold = 0.2;
+  int n = max_ignored_; // # of parameters skipped
+
+  StateCostRecord *first_record = first_state;
+  StateCostRecord *second_record = second_state;
+  bool is_comparable = true;
+  ConstraintTrace first_constraints = first_record->constraints;
+  ConstraintTrace second_constraints = second_record->constraints;
+  if(first_record->constraints.size() != second_record->constraints.size()) {
+    result->log << "state " << first_state->id << "'is not comparable with" <<
+      " state " << second_state->id << endl;
+    return;
+  }
+
+  ConstraintTrace first_combination, second_combination;
+  vector<uint> combination_indices;
+  // The constraint combinations the pair is comparable under. The diff and
+  // critical path of the pair do not depend on the combination, so only
+  // the first one computes them; the others are just recorded.
+  vector<vector<uint> > comparable_combinations;
+
+  std::function<void(int, int)> make_comparison = [=, &make_comparison, 
+                    &comparable_combinations] (int oft, int k) mutable -> void {
+
+    if (k == 0)
+    {
+      is_comparable = true;
 
-        for (uint i = oft; i <= first_constraints.size() - k; ++i) {
-          first_combination.push_back(first_constraints[i]);
-          second_combination.push_back(second_constraints[i]);
-          make_comparison (i+1, k-1);
-          first_combination.pop_back();
-          second_combination.pop_back();
+      for (uint i = 0 ; i < first_combination.size(); ++i) {
+        ConstraintItem first_constraint = first_combination[i];
+        ConstraintItem second_constraint = second_combination[i];
+        if (first_constraint.value != second_constraint.value) {
+          result->log << "state " << first_state->id << "'is not compareable with" <<
+                        " state " << second_state->id << endl;
+          is_comparable = false;
+          break;
         }
 
-      };
+        if(first_constraint.variable_number != second_constraint.variable_number)
+          result->console << "error\n";
+      }
 
-      for (int i = 0; i <= n; ++i) {
-        uint k = first_constraints.size() - i;
-        if (k < 0 || k > first_constraints.size())
-          continue;
-        make_comparison(0, k);
+      if(!is_comparable)
+        return;
+      comparable_combinations.push_back(combination_indices);
+      if (comparable_combinations.size() > 1)
+        return;
+
+      // print constraints
+      result->log <<  "state [" <<  first_record->id <<"]: target constraint = ";
+      if (first_record->target_constraints.size())
+        result->log << first_record->target_constraints[0].value;
+      else result->log << "null";
+      result->log << ", constraints = ";
+      for (auto i = first_constraints.begin(); i != first_constraints.end(); ++i) {
+        result->log << i->value << " ";
+      }
+      result->log <<  "\nstate [" <<  second_record->id <<"]: target constraint = ";
+      if (second_record->target_constraints.size())
+        result->log << second_record->target_constraints[0].value;
+      else result->log << "null";
+      result->log << ", constraints = ";
+      for (auto i = second_constraints.begin(); i != second_constraints.end(); ++i) {
+        result->log << i->value << " ";
+      }
+      result->log << endl;
+
+
+      if (first_state->execution_time > second_state->execution_time) {
+        // ensure second_record always has larger execution time
+        result->log << "state " << first_state->id << "'s execution time " <<
+                      first_state->execution_time << " > state " << second_state->id <<
+                      "'s execution_time " << second_state->execution_time << endl;
+        first_record = second_state;
+        second_record = first_state;
+      }
+
+      double latency_diff_percent = 1.0 * (second_record->execution_time -
+          first_record->execution_time) / first_record->execution_time;
+      result->log << "execution time for state " << first_record->id <<
+                    " and state " << second_record->id << " differ by " << latency_diff_percent << endl;
+      if (latency_diff_percent < latency_diff_percent_threshold) {
+        // latencies are similar, skip diff
+        return;
+      }
+
+      result->log << "comparing cost record for state " << first_record->id <<
+                    " and state " << second_record->id << endl;
+      DiffTrace diff_trace;
+      DiffOrder diff_order;
+      // By default we diff in process, or use gnu_diff_trace if asked to
+      if (diff_engine_ == DIFF_ENGINE_GNU) {
+        gnu_diff_trace(first_record->id, second_record->id, first_record->trace,
+                       second_record->trace, diff_trace);
+      } else {
+        DiffStats stats;
+        if (diff_engine_ == DIFF_ENGINE_TREE) {
+          tree_diff(first_record->trace, *call_trees_.at(first_record), 
+              second_record->trace, *call_trees_.at(second_record), tree_diff_threshold_,
+              &diff_trace, &diff_order, &stats, &tree_diff_cache_);
+        } else {
+          diff_function_traces(first_record->trace, second_record->trace, diff_engine_,
+              &diff_trace, &stats);
+        }
+        result->log << "diffed in " << stats.mode() << " mode, peak diff memory " 
+          << stats.peak_bytes << " bytes" << endl;
+        if (stats.identical)
+          result->log << "the call trees are identical" << endl;
+        else if (stats.call_tree)
+          result->log << "aligned " << stats.child_lists << " child lists, pruned " 
+            << stats.pruned << " equal subtrees, trimmed " << stats.skipped 
+            << " subtrees below the threshold" << endl;
+        write_diff_log(first_record->id, second_record->id, diff_trace);
       }
+      result->log << "obtained a diff trace of size " << diff_trace.size() << endl;
+      if (compute_diff_latency(first_record->trace, second_record->trace, diff_trace,
+            &diff_order, &result->diff_latency)) {
+        result->log << "computed the diff latency for " <<
+                      second_record->trace.size() << " trace items " << endl;
+        result->diffed = second_record;
+        result->base_id = first_record->id;
+        find_critical_path(second_record->trace, result->diff_latency, 
+            &result->critical_path);
+        result->console << "Successfully computed the differential critical path for state pair <"
+             << first_record->id << "," << second_record->id << ">" << endl;
+      }
+
+      return;
+    }
 
+    for (uint i = oft; i <= first_constraints.size() - k; ++i) {
+      first_combination.push_back(first_constraints[i]);
+      second_combination.push_back(second_constraints[i]);
+      combination_indices.push_back(i);
+      make_comparison (i+1, k-1);
+      first_combination.pop_back();
+      second_combination.pop_back();
+      combination_indices.pop_back();
     }
+
+  };
+
+  for (int i = 0; i <= n; ++i) {
+    uint k = first_constraints.size() - i;
+    if (k < 0 || k > first_constraints.size())
+      continue;
+    make_comparison(0, k);
   }
 
+  if (comparable_combinations.size() > 1) {
+    result->log << "state " << first_state->id << " and state " << second_state->id 
+      << " are comparable under " << comparable_combinations.size() 
+      << " combinations of their constraints:";
+    for (auto cit = comparable_combinations.begin(); cit != comparable_combinations.end(); ++cit) {
+      result->log << " {";
+      for (auto iit = cit->begin(); iit != cit->end(); ++iit)
+        result->log << (iit == cit->begin() ? "" : " ") << *iit;
+      result->log << "}";
+    }
+    result->log << endl;
+  }
+}
+
+void VioletTraceAnalyzer::finish_analysis(StateCostTable *cost_table) {
   for (auto record_iterator = cost_table->begin();
        record_iterator != cost_table->end(); ++record_iterator) {
-    result_file_ << "[State " << record_iterator->first
+    result_file_ << "[State " << record_iterator->id
            << "] => the number of instruction is "
-           << record_iterator->second.instruction_count
+           << record_iterator->instruction_count
            << ",the number of syscall is "
-           << record_iterator->second.syscall_count
+           << record_iterator->syscall_count
            << ", the total execution time "
-           << record_iterator->second.execution_time << "ms\n";
+           << record_iterator->execution_time << "ms\n";
   }
   analysis_log_.close();
   result_file_.close();
@@ -329,16 +872,25 @@ void VioletTraceAnalyzer::analyze_cost_table(StateCostTable *cost_table) {
     << "Intermediate data is written to directory '" << out_dir_ << "'" << endl;
 }
 
-bool VioletTraceAnalyzer::compute_diff_latency(FunctionTrace &first_trace, 
-    FunctionTrace &second_trace, FunctionTrace &diff_trace)
+bool VioletTraceAnalyzer::compute_diff_latency(const FunctionTrace &first_trace, 
+    const FunctionTrace &second_trace, DiffTrace &diff_trace, const DiffOrder *order,
+    vector<double> *diff_latency)
 {
+  // the item at a position of the diff
+  auto first_at = [order](size_t idx) -> size_t {
+    return order == NULL || order->empty() ? idx : order->first[idx];
+  };
+  auto second_at = [order](size_t idx) -> size_t {
+    return order == NULL || order->empty() ? idx : order->second[idx];
+  };
   size_t first_idx = 0, second_idx = 0, diff_idx = 0;
   size_t first_size = first_trace.size();
   size_t second_size = second_trace.size();
   size_t diff_size = diff_trace.size();
+  diff_latency->assign(second_size, 0);
 
   long long diff_pos = -1;
-  FunctionTraceItem *first_item = NULL, *second_item = NULL, *diff_item = NULL;
+  FunctionTraceItem *diff_item = NULL;
   while (second_idx < second_size) {
     if (diff_idx < diff_size) {
       diff_item = &diff_trace.at(diff_idx);
@@ -368,23 +920,23 @@ bool VioletTraceAnalyzer::compute_diff_latency(FunctionTrace &first_trace,
     while (*common_idx < *common_size) {
       assert(first_idx < first_size);
       assert(second_idx < second_size);
-      first_item = &first_trace.at(first_idx);
-      second_item = &second_trace.at(second_idx);
-      assert(first_item->function == second_item->function);
-      second_item->diff.latency = second_item->execution_time - first_item->execution_time;
+      size_t first_item = first_at(first_idx), second_item = second_at(second_idx);
+      assert(first_trace.function(first_item) == second_trace.function(second_item));
+      (*diff_latency)[second_item] = second_trace.execution_time(second_item) -
+          first_trace.execution_time(first_item);
       second_idx++;
       first_idx++;
     }
     assert(*common_idx == *common_size);
     if (diff_pos >= 0 && diff_item != NULL) {
       if (diff_item->diff.flag == DIFF_COM) {
-        first_item = &first_trace.at(first_idx);
-        second_item = &second_trace.at(second_idx);
-        assert(first_item->function == second_item->function);
-        second_item->diff.latency = second_item->execution_time - first_item->execution_time;
+        size_t first_item = first_at(first_idx), second_item = second_at(second_idx);
+        assert(first_trace.function(first_item) == second_trace.function(second_item));
+        (*diff_latency)[second_item] = second_trace.execution_time(second_item) -
+            first_trace.execution_time(first_item);
       } else if (diff_item->diff.flag == DIFF_ADD) {
-        second_item = &second_trace.at(second_idx);
-        second_item->diff.latency = second_item->execution_time;
+        size_t second_item = second_at(second_idx);
+        (*diff_latency)[second_item] = second_trace.execution_time(second_item);
       }
       diff_idx++;
     }
@@ -408,61 +960,6 @@ inline DiffChangeFlag VioletTraceAnalyzer::get_change_flag(const string &line) {
   return DIFF_NA;
 }
 
-bool VioletTraceAnalyzer::dtl_diff_trace(int first_trace_id, int second_trace_id,
-    FunctionTrace &first_trace, FunctionTrace &second_trace,
-    FunctionTrace &diff_trace) {
-  ofstream diff_log(get_state_diff_file_name(first_trace_id, second_trace_id));
-  time_t now = time(nullptr);
-  {
-    stringstream ss1, ss2;
-    ss1 << "violet_trace_state_" << first_trace_id;
-    ss2 << "violet_trace_state_" << second_trace_id;
-    diff_log << "--- "<< ss1.str() << "\t" << put_time(localtime(&now), "%Y-%m-%d %H:%M:%S %z") << endl;
-    now = time(nullptr);
-    diff_log << "+++ "<< ss2.str() << "\t" << put_time(localtime(&now), "%Y-%m-%d %H:%M:%S %z") << endl;
-  }
-  dtl::Diff<FunctionTraceItem, FunctionTrace > diff(first_trace, second_trace);
-  diff.onHuge();
-  diff.compose();
-
-  diff.composeUnifiedHunks();
-  diff.printUnifiedFormat(diff_log, true);
-  auto &hunks = diff.getUniHunks();
-  long long old_a = -1, old_c = -1, old_idx = -1, new_idx = -1;
-  for (auto hit = hunks.begin(); hit != hunks.end(); ++hit) {
-    // FIXME: the dtl library is buggy, it will output incorrect hunk information
-    // we should probably use the `diff' command line directly.
-    if ((old_a > 0 && hit->a < old_a) || (old_c > 0 && hit->c < old_c)) {
-      cerr << "unsorted hunk detected at " << "@@ -" << hit->a << "," << hit->b << " +" << hit->c << "," << hit->d << " @@" << endl;
-      old_a = hit->a;
-      old_c = hit->c;
-      continue;
-    }
-    old_a = hit->a;
-    old_c = hit->c;
-    old_idx = hit->a + hit->common[0].size() - 1;
-    new_idx = hit->c + hit->common[0].size() - 1;
-    for (auto cit = hit->change.begin(); cit != hit->change.end(); ++cit) {
-      if (cit->second.type == dtl::SES_ADD) {
-        FunctionTraceItem item = cit->first;
-        item.diff.flag = DIFF_ADD;
-        item.diff.position = new_idx++;
-        diff_trace.push_back(item);
-      } else if (cit->second.type == dtl::SES_DELETE) {
-        FunctionTraceItem item = cit->first;
-        item.diff.flag = DIFF_DEL;
-        item.diff.position = old_idx++;
-        diff_trace.push_back(item);
-      } else if (cit->second.type == dtl::SES_COMMON) {
-        old_idx++;
-        new_idx++;
-      }
-    }
-  }
-  diff_log.close();
-  return true;
-}
-
 static regex hunkReg("^@@\\s*-(\\d+),(\\d+)\\s*\\+(\\d+),(\\d+)\\s*@@$");
 struct hunk_header {
   long long a, b, c, d;
@@ -470,19 +967,19 @@ struct hunk_header {
 
 bool VioletTraceAnalyzer::gnu_diff_trace(int first_trace_id, int second_trace_id,
     FunctionTrace &first_trace, FunctionTrace &second_trace,
-    FunctionTrace &diff_trace) {
+    DiffTrace &diff_trace) {
   string trace_key1_fname = get_trace_key_file_name(first_trace_id);
   string trace_key2_fname = get_trace_key_file_name(second_trace_id);
   ofstream trace_key1(trace_key1_fname), trace_key2(trace_key2_fname);
-  for (FunctionTrace::iterator fit = first_trace.begin(); fit != first_trace.end(); ++fit) {
+  for (size_t idx = 0; idx < first_trace.size(); ++idx) {
     // Here we must output the hash key of the trace item, which does not include
     // the execution time. Otherwise, almost each line will be different.
-    trace_key1 << fit->hash_key() << endl;
+    trace_key1 << hexval(first_trace.function(idx)) << endl;
   }
   trace_key1.close();
-  for (FunctionTrace::iterator fit = second_trace.begin(); fit != second_trace.end(); ++fit) {
+  for (size_t idx = 0; idx < second_trace.size(); ++idx) {
     // Similarly, we need to output the hash key
-    trace_key2 << fit->hash_key() << endl;
+    trace_key2 << hexval(second_trace.function(idx)) << endl;
   }
   trace_key2.close();
   string diff_log_name = get_state_diff_file_name(first_trace_id, second_trace_id);
@@ -522,12 +1019,12 @@ bool VioletTraceAnalyzer::gnu_diff_trace(int first_trace_id, int second_trace_id
       DiffChangeFlag flag = get_change_flag(line);
       assert(flag != DIFF_NA);
       if (flag == DIFF_ADD) {
-        FunctionTraceItem item(second_trace.at(new_idx));
+        FunctionTraceItem item(second_trace.base_item(new_idx));
         item.diff.flag = flag;
         item.diff.position = new_idx++;
         diff_trace.push_back(item);
       } else if (flag == DIFF_DEL) {
-        FunctionTraceItem item(first_trace.at(old_idx));
+        FunctionTraceItem item(first_trace.base_item(old_idx));
         item.diff.flag = flag;
         item.diff.position = old_idx++;
         diff_trace.push_back(item);
@@ -538,18 +1035,26 @@ bool VioletTraceAnalyzer::gnu_diff_trace(int first_trace_id, int second_trace_id
     }
   }
   diff_log.close();
+  write_diff_log(first_trace_id, second_trace_id, diff_trace);
+  return true;
+}
 
+void VioletTraceAnalyzer::write_diff_log(int first_trace_id, int second_trace_id,
+    const DiffTrace &diff_trace)
+{
   ofstream pure_diff_log(get_state_diff_log_name(first_trace_id, second_trace_id));
+  // called from the pair workers, so without localtime's shared buffer
   time_t now = time(nullptr);
+  struct tm local;
   {
     stringstream ss1, ss2;
     ss1 << "violet_trace_state_" << first_trace_id;
     ss2 << "violet_trace_state_" << second_trace_id;
-    pure_diff_log << "--- "<< ss1.str() << "\t" << put_time(localtime(&now), "%Y-%m-%d %H:%M:%S %z") << endl;
+    pure_diff_log << "--- "<< ss1.str() << "\t" << put_time(localtime_r(&now, &local), "%Y-%m-%d %H:%M:%S %z") << endl;
     now = time(nullptr);
-    pure_diff_log << "+++ "<< ss2.str() << "\t" << put_time(localtime(&now), "%Y-%m-%d %H:%M:%S %z") << endl;
+    pure_diff_log << "+++ "<< ss2.str() << "\t" << put_time(localtime_r(&now, &local), "%Y-%m-%d %H:%M:%S %z") << endl;
   }
-  for (FunctionTrace::iterator hit = diff_trace.begin(); hit != diff_trace.end(); ++hit) {
+  for (DiffTrace::const_iterator hit = diff_trace.begin(); hit != diff_trace.end(); ++hit) {
     if (hit->diff.flag == DIFF_ADD) {
       pure_diff_log << "+ " << *hit << "; @" << hit->diff.position << endl;
     } else if (hit->diff.flag == DIFF_DEL) {
@@ -557,64 +1062,110 @@ bool VioletTraceAnalyzer::gnu_diff_trace(int first_trace_id, int second_trace_id
     }
   }
   pure_diff_log.close();
-  return true;
 }
 
-void VioletTraceAnalyzer::compute_critical_path(StateCostRecord *record, int base_trace_id)
+void VioletTraceAnalyzer::find_critical_path(const FunctionTrace &trace,
+    const vector<double> &diff_latency, vector<FunctionTraceItem> *path) const
 {
   uint64_t parent_id = 0;
-  result_file_ << "[State " << record->id << "] critical path (compared to state " 
-   << base_trace_id << ") :" << endl;
-
   for (int i = 0; i < 30; i++) {
     double max_diff = 0;
     int max_idx = -1;
-    int idx = 0;
-    for (FunctionTrace::iterator fit = record->trace.begin();
-        fit != record->trace.end(); ++fit, ++idx) {
-      if (fit->parent_id == parent_id) {
-        if (fit->activity_id == parent_id) {
+    for (size_t idx = 0; idx < trace.size(); ++idx) {
+      if (trace.parent_id(idx) == parent_id) {
+        if (trace.activity_id(idx) == parent_id) {
           // this mainly happens for the entry function (activity_id = parent_id = 0)
           // we should skip this function, otherwise the entire critical path will
           // only contain the entry function.
           continue;
         }
-        const std::string function_str = hexval(fit->function).str();
-        if (function_str == black_list)
+        if (trace.function_id(idx) == black_list_id_)
           continue;
 
-        if (fit->diff.latency > max_diff) {
-          max_diff = fit->diff.latency;
+        if (diff_latency[idx] > max_diff) {
+          max_diff = diff_latency[idx];
           max_idx = idx;
         }
       }
     }
     if (max_idx < 0)
       break;
-    const FunctionTraceItem &result = record->trace[max_idx];
-    result_file_ << "\t=> ";
-    printFunctionTraceItem(result_file_, result, true);
-    result_file_ << endl;
-    parent_id = result.activity_id;
+    path->push_back(trace.base_item(max_idx));
+    path->back().diff.latency = diff_latency[max_idx];
+    parent_id = path->back().activity_id;
+  }
+}
+
+void VioletTraceAnalyzer::write_critical_path(ostream &o, int state_id, 
+    int base_trace_id, const vector<FunctionTraceItem> &path)
+{
+  o << "[State " << state_id << "] critical path (compared to state " 
+   << base_trace_id << ") :" << endl;
+
+  // resolve the source lines of the whole path in one pass
+  const LineTable &lines = symbol_table_.lines();
+  vector<SourceLine> path_lines;
+  if (!lines.empty()) {
+    vector<uint64_t> addresses;
+    for (auto it = path.begin(); it != path.end(); ++it) {
+      addresses.push_back(it->function - symbol_table_.load_base());
+      addresses.push_back(it->caller - symbol_table_.load_base());
+    }
+    lines.lookup_batch(addresses, &path_lines);
+  }
+  for (size_t i = 0; i < path.size(); ++i) {
+    o << "\t=> ";
+    if (path_lines.empty())
+      printFunctionTraceItem(o, path[i], true);
+    else
+      printFunctionTraceItem(o, path[i], true, &path_lines[2 * i],
+          &path_lines[2 * i + 1]);
+    o << endl;
   }
 }
 
+void VioletTraceAnalyzer::print_symbol(ostream &o, uint64_t address, 
+    const SourceLine *line)
+{
+  uint64_t offset;
+  Module *module = NULL;
+  struct obj_symbol *p = symbol_table_.resolve(address, &offset);
+  SymbolTable *table = &symbol_table_;
+  if (p == NULL && !module_map_.empty()) {
+    // not in the executable, try the shared libraries
+    p = module_map_.resolve(address, &offset, &module);
+    if (p != NULL)
+      table = module->symbols.get();
+  }
+  if (p == NULL)
+    return;
+  o << "<" << table->function_name(p);
+  if (offset != 0)
+    o << "+" << hexval(offset);
+  if (module != NULL)
+    o << "@" << module->name;
+  o << ">";
+
+  SourceLine found;
+  if (line == NULL || module != NULL) {
+    found = table->lines().lookup(address - table->load_base());
+    line = &found;
+  }
+  if (line->line != 0)
+    o << " at " << table->lines().file_name(line->file) << ":" << line->line;
+}
+
 ostream& VioletTraceAnalyzer::printFunctionTraceItem (ostream &o, 
-    const FunctionTraceItem &t, bool resolve)
+    const FunctionTraceItem &t, bool resolve, const SourceLine *function_line,
+    const SourceLine *caller_line)
 {
-  if (resolve && symbol_table_.size() > 0) {
+  if (resolve && (symbol_table_.size() > 0 || !module_map_.empty())) {
     // leverage the symbol table to resolve the function address
     // in the result
-    string func_addr = hexval(t.function).str();
-    struct obj_symbol *p = symbol_table_.get_symbol_by_saddr(func_addr);
-    o << "function @" << func_addr;
-    if (p != NULL)
-      o << "<" << p->function << ">";
-    func_addr = hexval(t.caller).str();
-    p = symbol_table_.get_symbol_by_saddr(func_addr);
-    o << ",caller @" << func_addr;
-    if (p != NULL)
-      o << "<" << p->function << ">";
+    o << "function @" << hexval(t.function);
+    print_symbol(o, t.function, function_line);
+    o << ",caller @" << hexval(t.caller);
+    print_symbol(o, t.caller, caller_line);
     o << ",activity_id " << t.activity_id << ",parent_id " << t.parent_id 
       << ",execution time " << t.execution_time << "ms,diff time " 
       << t.diff.latency << "ms";
@@ -624,6 +1175,112 @@ ostream& VioletTraceAnalyzer::printFunctionTraceItem (ostream &o,
 }
 
   
+static volatile sig_atomic_t follow_interrupted = 0;
+
+static void follow_interrupt_handler(int)
+{
+  follow_interrupted = 1;
+}
+
+// Parse the input and its constraints as they grow and re-analyze the 
+// states that got new records, until interrupted or neither file grows 
+// for config.follow_timeout seconds.
+static void follow_trace(TraceParserBase *parser, StateCostTable *cost_table,
+    VioletTraceAnalyzer *analyzer)
+{
+  FileWatcher watcher(config.input_path);
+  if (!config.constraint_path.empty())
+    watcher.add(config.constraint_path);
+  cout << "Following " << config.input_path << (watcher.using_inotify() ? 
+      " with inotify" : " by polling") << ", press Ctrl-C to stop" << endl;
+  signal(SIGINT, follow_interrupt_handler);
+  auto last_growth = chrono::steady_clock::now();
+  while (!follow_interrupted) {
+    if (watcher.wait()) {
+      set<int> changed_states;
+      if (!parser->parse_incremental(cost_table, &changed_states))
+        break;
+      if (!changed_states.empty()) {
+        analyzer->analyze_states(cost_table, &changed_states);
+        cout << "Re-analyzed " << changed_states.size() << " changed states out of "
+          << cost_table->size() << endl;
+      }
+      last_growth = chrono::steady_clock::now();
+    } else if (config.follow_timeout > 0) {
+      chrono::duration<double> idle = chrono::steady_clock::now() - last_growth;
+      if (idle.count() >= config.follow_timeout)
+        break;
+    }
+  }
+  signal(SIGINT, SIG_DFL);
+}
+
+static TraceParserBase *create_parser(const string &input_path, 
+    const string &constraint_path, int jobs)
+{
+  string log_ext = input_path.size() >= 4 ? input_path.substr(input_path.size() - 4, 4) : "";
+  if (TraceContainerParser::is_container(input_path)) {
+    return new TraceContainerParser(input_path, config.states);
+  } else if (log_ext.compare(".txt") == 0) {
+    return new TraceLogParser(input_path, constraint_path, jobs);
+  }
+  // if the input file ends with anything other than .txt, we will use
+  // the binary trace parser.
+  return new TraceDatParser(input_path, constraint_path);
+}
+
+// Parse the traces of several S2E processes concurrently and merge them
+// into cost_table. The state ids of each input are shifted past the ids 
+// of the inputs before it, so states of different processes never collide.
+// If a spill store is given, the parsers share the memory budget and 
+// evict the traces to it as they go.
+static bool parse_inputs(StateCostTable *cost_table, TraceSpillStore *spill_store)
+{
+  size_t input_cnt = config.input_paths.size();
+  vector<StateCostTable> tables(input_cnt);
+  vector<char> results(input_cnt, 0);
+  size_t worker_cnt = min((size_t) config.jobs, input_cnt);
+  // the workers left over are given to the log parsers
+  int parser_jobs = max(1, config.jobs / (int) input_cnt);
+  auto parse_input = [&](size_t worker) {
+    for (size_t i = worker; i < input_cnt; i += worker_cnt) {
+      TraceParserBase *parser = create_parser(config.input_paths[i], 
+          config.constraint_paths[i], parser_jobs);
+      if (spill_store != NULL)
+        parser->set_spill_store(spill_store, 
+            ((size_t) config.memory_budget << 20) / worker_cnt);
+      results[i] = parser->parse(&tables[i]) && parser->finish_spill(&tables[i]);
+      delete parser;
+      // number the functions here in parallel, merging only translates
+      // the ids of each input to the ids of the whole table
+      if (results[i])
+        tables[i].intern_functions();
+    }
+  };
+  vector<thread> workers;
+  for (size_t w = 1; w < worker_cnt; ++w)
+    workers.push_back(thread(parse_input, w));
+  parse_input(0);
+  for (size_t w = 0; w < workers.size(); ++w)
+    workers[w].join();
+
+  int id_offset = 0;
+  for (size_t i = 0; i < input_cnt; ++i) {
+    if (!results[i]) {
+      cerr << "Abort: failed to parse the trace file " << config.input_paths[i] << endl;
+      return false;
+    }
+    int id_limit = tables[i].id_limit();
+    if (input_cnt > 1) {
+      cout << "States " << id_offset << "-" << id_offset + id_limit - 1 
+        << " are states 0-" << id_limit - 1 << " of " << config.input_paths[i] << endl;
+    }
+    cost_table->merge(tables[i], id_offset);
+    id_offset += id_limit;
+  }
+  return true;
+}
+
 int analyzer_main(int argc, char **argv) {
   string line;
   StateCostTable cost_table;
@@ -632,31 +1289,51 @@ int analyzer_main(int argc, char **argv) {
     exit(1);
   }
 
-  TraceParserBase *parser;
-  string log_ext = config.input_path.substr(config.input_path.size() - 4, 4);
-  if (log_ext.compare(".txt") == 0) {
-    parser = new TraceLogParser(config.input_path, config.constraint_path);
-  } else {
-    // if the input file ends with anything other than .txt, we will use
-    // the binary trace parser.
-    parser = new TraceDatParser(config.input_path, config.constraint_path);
-  }
+  // with a memory budget, the traces are spilled from the start, so that
+  // the whole table is never in memory
+  TraceSpillStore spill_store;
+  if (config.memory_budget > 0 && (!make_directory(config.outdir) || 
+        !spill_store.open(config.outdir)))
+    cerr << "Falling back to in-memory analysis" << endl;
 
-  if (!parser->parse(&cost_table)) {
-    cerr << "Abort: failed to parse the trace file " << config.input_path << endl;
+  TraceParserBase *parser = NULL;
+  if (config.follow) {
+    parser = create_parser(config.input_path, config.constraint_path, config.jobs);
+  } else if (!parse_inputs(&cost_table, spill_store.is_open() ? &spill_store : NULL)) {
     exit(1);
   }
 
+  if (!config.convert_path.empty()) {
+    bool success = write_trace_container(config.convert_path, &cost_table,
+        config.compress);
+    delete parser;
+    return success ? 0 : 1;
+  }
+
   VioletTraceAnalyzer analyzer("violet_trace_analysis.log", config.outdir.c_str(),
       config.output_path.c_str(), config.symtable_path.c_str(),
       config.executable_path.c_str(), config.append_output, config.max_ignored);
+  analyzer.set_symbol_cache_dir(config.symcache_dir);
+  analyzer.set_jobs(config.jobs);
+  analyzer.set_maps_path(config.maps_path);
+  analyzer.set_diff_engine(config.diff_engine);
+  analyzer.set_tree_diff_threshold(config.tree_diff_threshold);
   if (!analyzer.init()) {
     analyzer.cleanup();
     cerr << "Abort: failed to initialize violet trace analyzer" << endl;
     exit(1);
   }
+  analyzer.set_load_base(config.load_base);
   analyzer.build_black_list();
-  analyzer.analyze_cost_table(&cost_table);
+  analyzer.set_memory_budget((size_t) config.memory_budget << 20, &spill_store);
+  if (config.follow) {
+    analyzer.set_follow_mode(true);
+    follow_trace(parser, &cost_table, &analyzer);
+    analyzer.finish_analysis(&cost_table);
+  } else {
+    analyzer.analyze_cost_table(&cost_table);
+  }
   analyzer.cleanup();
+  delete parser;
   return 0;
 }
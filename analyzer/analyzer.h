@@ -13,14 +13,51 @@
 #define VIOLET_LOG_ANALYZER_ANALYZER_H
 
 #include <map>
+#include <memory>
+#include <set>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
 
+#include "diff.h"
+#include "modmap.h"
+#include "spill.h"
 #include "trace.h"
 #include "symtable.h"
 
+// A state pair to compare, or, if second is NULL, the trace file of first
+// to write. Tasks take effect in the order they are scheduled in.
+struct PairTask {
+  StateCostRecord *first;
+  StateCostRecord *second;
+
+  PairTask(StateCostRecord *first, StateCostRecord *second): first(first), 
+    second(second) { }
+};
+
+// What comparing a state pair produced. Pairs are compared concurrently
+// without touching the shared traces or outputs; their results are then
+// merged in task order.
+struct PairResult {
+  std::ostringstream log;      // for the analysis log
+  std::ostringstream console;  // for stdout
+  // the state whose diff latencies were computed, NULL if none, and the
+  // state it was compared to
+  StateCostRecord *diffed;
+  int base_id;
+  std::vector<double> diff_latency;
+  std::vector<FunctionTraceItem> critical_path;
+
+  PairResult(): diffed(NULL), base_id(-1) { }
+};
+
+// At most this many pair results, each with a diff latency column, are
+// held at once by a given number of workers. A worker does not start a
+// task until the tasks this far before it have been merged.
+#define PAIR_RESULT_WINDOW(workers) (2 * (workers))
+
 class VioletTraceAnalyzer {
   public:
     VioletTraceAnalyzer(const char* log_path, const char* outdir, 
@@ -32,17 +69,52 @@ class VioletTraceAnalyzer {
     bool init();
     void cleanup();
 
-    bool dtl_diff_trace(int first_trace_id, int second_trace_id,
-        FunctionTrace &first_trace, FunctionTrace &second_trace,
-        FunctionTrace &diff_trace);
     bool gnu_diff_trace(int first_trace_id, int second_trace_id,
         FunctionTrace &first_trace, FunctionTrace &second_trace,
-        FunctionTrace &diff_trace);
-    bool compute_diff_latency(FunctionTrace &first_trace, 
-        FunctionTrace &second_trace, FunctionTrace &diff_trace);
-    void compute_critical_path(StateCostRecord *record, int base_trace_id);
+        DiffTrace &diff_trace);
+    // Write the added and deleted items of a diff trace to the diff log
+    void write_diff_log(int first_trace_id, int second_trace_id,
+        const DiffTrace &diff_trace);
+    // Compute the diff latency of every item of the second trace into 
+    // diff_latency. The positions of diff_trace are item indices unless 
+    // order says otherwise.
+    bool compute_diff_latency(const FunctionTrace &first_trace, 
+        const FunctionTrace &second_trace, DiffTrace &diff_trace, const DiffOrder *order,
+        std::vector<double> *diff_latency);
+    // Follow the children with the largest diff latency from the root
+    void find_critical_path(const FunctionTrace &trace, 
+        const std::vector<double> &diff_latency, std::vector<FunctionTraceItem> *path) const;
+    void write_critical_path(std::ostream &o, int state_id, int base_trace_id,
+        const std::vector<FunctionTraceItem> &path);
     void analyze_cost_table(StateCostTable *cost_table);
+    // Diff the state pairs that involve a changed state (all pairs if
+    // changed_states is NULL) and report their critical paths
+    void analyze_states(StateCostTable *cost_table, const std::set<int> *changed_states);
+    // Diff two states under every combination of their constraints. Only
+    // reads the states and writes its outputs to result, so it can run on
+    // several pairs at once.
+    void compare_states(StateCostRecord *first_state, StateCostRecord *second_state,
+        PairResult *result);
+    // Run the tasks on up to jobs threads and merge their results in order,
+    // so the outputs do not depend on the number of threads
+    void run_pairs(const std::vector<PairTask> &tasks);
+    // Apply a task's result to the traces and outputs
+    void commit_pair(const PairTask &task, PairResult *result);
+    void write_trace_file(const StateCostRecord *record);
+    // Report the per-state summary and close the output files
+    void finish_analysis(StateCostTable *cost_table);
     void build_black_list();
+    // Keep at most bytes of traces in memory, spilling the rest to store;
+    // 0 keeps everything in memory. The store may already hold traces
+    // spilled while parsing.
+    void set_memory_budget(size_t bytes, TraceSpillStore *store)
+    {
+      memory_budget_ = bytes;
+      spill_store_ = store;
+    }
+    // In follow mode a re-analyzed pair replaces its earlier critical path,
+    // and the result file is rewritten after every round of analysis
+    void set_follow_mode(bool follow) { follow_mode_ = follow; }
 
     static DiffChangeFlag get_change_flag(const std::string &line);
 
@@ -74,8 +146,26 @@ class VioletTraceAnalyzer {
       return ss.str();
     }
 
+    // The source lines of the function and caller are looked up unless
+    // they are given
     std::ostream& printFunctionTraceItem (std::ostream &o, 
-        const FunctionTraceItem &t, bool resolve=true);
+        const FunctionTraceItem &t, bool resolve=true, 
+        const SourceLine *function_line=NULL, const SourceLine *caller_line=NULL);
+    // Print <function+0xoffset> for the function containing address,
+    // followed by its source line if it is known
+    void print_symbol(std::ostream &o, uint64_t address, const SourceLine *line=NULL);
+
+    void set_load_base(uint64_t base) { symbol_table_.set_load_base(base); }
+    // The maps snapshot of the traced process whose modules are loaded
+    void set_maps_path(const std::string &path) { maps_path_ = path; }
+    // Number of worker threads
+    void set_jobs(int jobs) { jobs_ = jobs; }
+    void set_diff_engine(DiffEngine engine) { diff_engine_ = engine; }
+    // Calls whose execution times differ by less than this many ms are not
+    // searched below by the tree diff
+    void set_tree_diff_threshold(double ms) { tree_diff_threshold_ = ms; }
+    // Where the parsed symbol table is cached, the output directory if empty
+    void set_symbol_cache_dir(const std::string &dir) { symcache_dir_ = dir; }
 
  private:
     std::string log_path_;
@@ -83,11 +173,44 @@ class VioletTraceAnalyzer {
     std::string out_path_;
     std::string executable_path_;
     std::string symtab_path_;
+    std::string symcache_dir_;
+    std::string maps_path_;
     std::ofstream analysis_log_;
     std::ofstream result_file_;
     SymbolTable symbol_table_;
+    ModuleMap module_map_;
     int max_ignored_;
-    std::string black_list;
+    size_t memory_budget_;
+    bool follow_mode_;
+    // the size of the result file before this run, kept when rewriting it
+    off_t result_base_;
+    // in follow mode, the latest critical path block of each state pair
+    std::map<std::pair<int, int>, std::string> latest_paths_;
+    int jobs_;
+    DiffEngine diff_engine_;
+    double tree_diff_threshold_;
+    // the tree diffs by the call trees of the pair
+    TreeDiffCache tree_diff_cache_;
+    // the call trees of the traces in memory, for the tree diff; each is
+    // built once and shared by all the pairs of its state
+    std::unordered_map<const StateCostRecord *, std::unique_ptr<CallTree> > call_trees_;
+    // the function left out of critical paths, 0 if none, and its id in
+    // the cost table being analyzed
+    uint64_t black_list_address_;
+    uint32_t black_list_id_;
+    TraceSpillStore *spill_store_;
+
+    // Load the symbol table of the executable from the cache or parse it
+    bool load_symbols();
+    // Read the symbol table from the executable or the symbol file
+    bool parse_symbols();
+    // Analyze all pairs with only a tile pair of traces in memory at a 
+    // time. Returns false if the table fits in the budget anyway.
+    bool analyze_states_out_of_core(StateCostTable *cost_table);
+    // Write the latest critical paths after what the file held before
+    void rewrite_result();
+    // (Re)build the call trees of records if the tree diff is used
+    void build_call_trees(const std::vector<StateCostRecord *> &records);
 
 };
 
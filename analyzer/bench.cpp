@@ -0,0 +1,226 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+// Microbenchmark of the S2E log line parsing. The LatencyTracker lines
+// are synthesized from a binary trace file and parsed `scale` times with
+// the original stringstream-based extractors and with LogLineScanner.
+// The first two states of the trace are then diffed `scale / 100` times
+// with each in-process diff engine, flat and along the call tree.
+//
+// Usage: trace_bench [trace.dat] [scale]
+
+#include "diff.h"
+#include "parser.h"
+#include "scanner.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+using namespace std;
+
+static uint64_t alloc_cnt = 0;
+
+void *operator new(size_t size)
+{
+  alloc_cnt++;
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == NULL)
+    throw bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static bool load_lines(const string &path, vector<string> &lines)
+{
+  ifstream dat_file(path, ios::in | ios::binary);
+  if (!dat_file.is_open())
+    return false;
+  struct _traceDatRecord record;
+  while (dat_file.read((char *) &record, sizeof(record))) {
+    stringstream ss;
+    ss << "1000 [State " << record.state_id << "] LatencyTracker: Function " 
+      << hexval(record.address) << "; activityId " << record.acticityId 
+      << "; caller " << hexval(record.callerAddress) << "; parentId " 
+      << record.parentId << "; runs " << record.execution_time << "ms;";
+    lines.push_back(ss.str());
+  }
+  return true;
+}
+
+static void report(const char *name, size_t parsed, uint64_t allocs, double secs,
+    uint64_t checksum)
+{
+  cout << name << ": " << parsed << " lines in " << secs << "s (" 
+    << parsed / secs << " lines/s), " << allocs << " allocations, checksum " 
+    << hexval(checksum) << endl;
+}
+
+static void bench_diff(const string &path, int scale)
+{
+  StateCostTable table;
+  TraceDatParser parser(path, "");
+  if (!parser.parse(&table) || table.size() < 2) {
+    cerr << "Need two states in " << path << " to benchmark the diff" << endl;
+    return;
+  }
+  table.intern_functions();
+  StateCostTable::iterator it = table.begin();
+  const FunctionTrace &first = it->trace;
+  const FunctionTrace &second = (++it)->trace;
+  const vector<uint32_t> &a = first.function_ids();
+  const vector<uint32_t> &b = second.function_ids();
+  int iterations = scale / 100 > 0 ? scale / 100 : 1;
+
+  // trimming a trace against itself, the best case for the prefix scan
+  size_t trimmed = 0;
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < iterations * 100; ++i) {
+    size_t p = 0;
+    while (p < a.size() && a[p] == a[p])
+      p++;
+    trimmed += p;
+  }
+  chrono::duration<double> scalar = chrono::steady_clock::now() - start;
+  start = chrono::steady_clock::now();
+  for (int i = 0; i < iterations * 100; ++i)
+    trimmed -= common_prefix(a.data(), a.data(), a.size());
+  chrono::duration<double> simd = chrono::steady_clock::now() - start;
+  int trims = iterations * 100;
+  cout << "prefix trim: " << a.size() << " ids, scalar " << scalar.count() / trims * 1e6
+    << "us, simd " << simd.count() / trims * 1e6 << "us, speedup "
+    << scalar.count() / simd.count() << "x" << (trimmed == 0 ? "" : " (MISMATCH)") << endl;
+
+  const char *names[] = {"myers greedy", "myers linear", "bit-parallel lcs", "call tree"};
+  double secs[4];
+  CallTree first_tree, second_tree;
+  first_tree.build(first);
+  second_tree.build(second);
+  for (int engine = 0; engine < 4; ++engine) {
+    vector<DiffEdit> edits;
+    DiffTrace diff_trace;
+    DiffStats stats;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      edits.clear();
+      diff_trace.clear();
+      if (engine == 3) {
+        DiffOrder order;
+        tree_diff(first, first_tree, second, second_tree, 0, &diff_trace, &order, &stats);
+      } else if (engine == 2) {
+        lcs_diff(a.data(), a.size(), b.data(), b.size(), &edits, &stats);
+      } else {
+        myers_diff(a.data(), a.size(), b.data(), b.size(), &edits, &stats,
+            engine == 0 ? (size_t) -1 : 0);
+      }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    secs[engine] = elapsed.count() / iterations;
+    cout << names[engine] << ": " << a.size() << " x " << b.size() << " ids, "
+      << edits.size() + diff_trace.size() << " edits in " << secs[engine] * 1e3 
+      << "ms, peak memory " << stats.peak_bytes << " bytes" << endl;
+  }
+  cout << "speedup of bit-parallel lcs " << secs[0] / secs[2] << "x over myers greedy, "
+    << secs[1] / secs[2] << "x over myers linear" << endl;
+  cout << "speedup of the call tree diff " << secs[1] / secs[3] << "x over myers linear" 
+    << endl;
+}
+
+int main(int argc, char **argv)
+{
+  string path = argc > 1 ? argv[1] : "test/LatencyTrace1_autocommit.dat";
+  int scale = argc > 2 ? atoi(argv[2]) : 1000;
+  vector<string> lines;
+  if (!load_lines(path, lines) || lines.empty()) {
+    cerr << "Unable to load trace records from " << path << endl;
+    return 1;
+  }
+  const string expression = "LatencyTracker: Function";
+
+  // The function and caller addresses are left out of the checksum since
+  // s2f<uint64_t> cannot decode hex values.
+  uint64_t checksum = 0;
+  uint64_t allocs = alloc_cnt;
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < scale; ++i) {
+    for (auto lit = lines.begin(); lit != lines.end(); ++lit) {
+      const string &line = *lit;
+      if (line.find(expression) == string::npos)
+        continue;
+      int id = TraceLogParser::get_state_id(line);
+      FunctionTraceItem item;
+      item.activity_id = s2f<uint64_t>(TraceLogParser::get_address(line, "activityId"));
+      item.parent_id = s2f<uint64_t>(TraceLogParser::get_address(line, "parentId"));
+      item.function = s2f<uint64_t>(TraceLogParser::get_address(line, "Function"));
+      item.caller = s2f<uint64_t>(TraceLogParser::get_address(line, "caller"));
+      item.execution_time = s2f<double>(TraceLogParser::get_execution_time(line, "runs"));
+      checksum += id + item.activity_id + item.parent_id + (uint64_t) item.execution_time;
+    }
+  }
+  chrono::duration<double> legacy = chrono::steady_clock::now() - start;
+  report("stringstream", lines.size() * scale, alloc_cnt - allocs, legacy.count(), checksum);
+
+  checksum = 0;
+  allocs = alloc_cnt;
+  start = chrono::steady_clock::now();
+  for (int i = 0; i < scale; ++i) {
+    for (auto lit = lines.begin(); lit != lines.end(); ++lit) {
+      int id;
+      FunctionTraceItem item;
+      if (!LogLineScanner::scan_function_line(lit->data(), lit->data() + lit->size(),
+            &id, &item))
+        continue;
+      checksum += id + item.activity_id + item.parent_id + (uint64_t) item.execution_time;
+    }
+  }
+  chrono::duration<double> scanner = chrono::steady_clock::now() - start;
+  report("scanner", lines.size() * scale, alloc_cnt - allocs, scanner.count(), checksum);
+
+  cout << "speedup " << legacy.count() / scanner.count() << "x" << endl;
+
+  // Line filtering on a log where 19 out of 20 lines come from other plugins
+  vector<string> noisy;
+  for (auto lit = lines.begin(); lit != lines.end(); ++lit) {
+    for (int i = 0; i < 19; ++i)
+      noisy.push_back("1000 [State 0] BaseInstructions: Message from guest (0x7ffc4f3d2a10): "
+          "inserting symbolic data for config variable autocommit");
+    noisy.push_back(*lit);
+  }
+  const string case_expression = "TestCaseGenerator: generating test case at address";
+  int filter_scale = scale / 20 > 0 ? scale / 20 : 1;
+  checksum = 0;
+  start = chrono::steady_clock::now();
+  for (int i = 0; i < filter_scale; ++i) {
+    for (auto lit = noisy.begin(); lit != noisy.end(); ++lit) {
+      if (lit->find(case_expression) != string::npos)
+        checksum += 2;
+      if (lit->find(expression) != string::npos)
+        checksum++;
+    }
+  }
+  chrono::duration<double> find_filter = chrono::steady_clock::now() - start;
+  report("find filter", noisy.size() * filter_scale, 0, find_filter.count(), checksum);
+
+  checksum = 0;
+  start = chrono::steady_clock::now();
+  for (int i = 0; i < filter_scale; ++i) {
+    for (auto lit = noisy.begin(); lit != noisy.end(); ++lit) {
+      checksum += LogLineScanner::classify(lit->data(), lit->data() + lit->size());
+    }
+  }
+  chrono::duration<double> classify_filter = chrono::steady_clock::now() - start;
+  report("classify filter", noisy.size() * filter_scale, 0, classify_filter.count(), checksum);
+  cout << "speedup " << find_filter.count() / classify_filter.count() << "x" << endl;
+
+  bench_diff(path, scale);
+  return 0;
+}
@@ -0,0 +1,137 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "calltree.h"
+
+#include <algorithm>
+#include <assert.h>
+
+using namespace std;
+
+// The finalizer of splitmix64
+static inline uint64_t mix_hash(uint64_t h)
+{
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+void CallTree::build(const FunctionTrace &trace)
+{
+  clear();
+  size_t n = trace.size();
+  assert(n < CALL_TREE_NONE);
+  assert(trace.has_function_ids());
+
+  // the items by activity id, then function address; the children of a
+  // node are taken in this order
+  vector<uint32_t> by_activity(n);
+  for (size_t i = 0; i < n; ++i)
+    by_activity[i] = i;
+  sort(by_activity.begin(), by_activity.end(), [&trace](uint32_t x, uint32_t y) {
+    if (trace.activity_id(x) != trace.activity_id(y))
+      return trace.activity_id(x) < trace.activity_id(y);
+    if (trace.function(x) != trace.function(y))
+      return trace.function(x) < trace.function(y);
+    return x < y;
+  });
+
+  parent_.assign(n, CALL_TREE_NONE);
+  child_begin_.assign(n + 2, 0);
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t parent_id = trace.parent_id(i);
+    if (parent_id < trace.activity_id(i)) {
+      auto first = lower_bound(by_activity.begin(), by_activity.end(), parent_id,
+          [&trace](uint32_t x, uint64_t id) { return trace.activity_id(x) < id; });
+      auto last = first;
+      while (last != by_activity.end() && trace.activity_id(*last) == parent_id)
+        ++last;
+      if (first != last) {
+        // the candidate whose function contains the call site; of equal
+        // candidates (e.g., the entry functions, all with activity id 0)
+        // the first one gets every child
+        auto it = upper_bound(first, last, trace.caller(i),
+            [&trace](uint64_t caller, uint32_t x) { return caller < trace.function(x); });
+        if (it != first)
+          --it;
+        while (it != first && trace.function(*(it - 1)) == trace.function(*it))
+          --it;
+        parent_[i] = *it;
+      }
+    }
+    child_begin_[(parent_[i] == CALL_TREE_NONE ? n : parent_[i]) + 1]++;
+  }
+  for (size_t i = 1; i < n + 2; ++i)
+    child_begin_[i] += child_begin_[i - 1];
+
+  children_.resize(n);
+  child_ids_.resize(n);
+  vector<uint32_t> cursor(child_begin_.begin(), child_begin_.end() - 1);
+  for (size_t k = 0; k < n; ++k) {
+    uint32_t i = by_activity[k];
+    uint32_t slot = cursor[parent_[i] == CALL_TREE_NONE ? n : parent_[i]]++;
+    children_[slot] = i;
+    child_ids_[slot] = trace.function_id(i);
+  }
+
+  // the virtual root is not part of the pre-order
+  preorder_.reserve(n);
+  position_.resize(n);
+  vector<uint32_t> stack;
+  for (size_t c = child_count(n); c > 0; --c)
+    stack.push_back(children(n)[c - 1]);
+  while (!stack.empty()) {
+    uint32_t node = stack.back();
+    stack.pop_back();
+    position_[node] = preorder_.size();
+    preorder_.push_back(node);
+    for (size_t c = child_count(node); c > 0; --c)
+      stack.push_back(children(node)[c - 1]);
+  }
+  assert(preorder_.size() == n);
+
+  // one bottom-up pass: in reverse pre-order, the children of a node come
+  // before it; the root comes last
+  subtree_size_.assign(n, 1);
+  hash_.resize(n + 1);
+  auto hash_node = [this](uint32_t node, uint64_t function) {
+    // xoring a child in would cancel out a leaf child of the same 
+    // function; this combine keeps the node and the child order apart
+    uint64_t h = mix_hash(function);
+    for (size_t c = 0; c < child_count(node); ++c)
+      h = mix_hash(h * 0x9E3779B97F4A7C15ULL + hash_[children(node)[c]] + c);
+    hash_[node] = h;
+  };
+  for (size_t k = n; k > 0; --k) {
+    uint32_t node = preorder_[k - 1];
+    hash_node(node, trace.function(node));
+    if (parent_[node] != CALL_TREE_NONE)
+      subtree_size_[parent_[node]] += subtree_size_[node];
+  }
+  hash_node(n, 0);
+}
+
+void CallTree::clear()
+{
+  parent_.clear();
+  child_begin_.assign(2, 0);
+  children_.clear();
+  child_ids_.clear();
+  preorder_.clear();
+  position_.clear();
+  subtree_size_.clear();
+  hash_.clear();
+}
+
+size_t CallTree::memory_usage() const
+{
+  return (parent_.size() + child_begin_.size() + children_.size() + child_ids_.size() +
+      preorder_.size() + position_.size() + subtree_size_.size()) * sizeof(uint32_t) +
+    hash_.size() * sizeof(uint64_t);
+}
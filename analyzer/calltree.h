@@ -0,0 +1,81 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_CALLTREE_H
+#define VIOLET_LOG_ANALYZER_CALLTREE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "trace.h"
+
+#define CALL_TREE_NONE UINT32_MAX
+
+// Bytes a call tree takes per trace item, see CallTree::memory_usage
+#define CALL_TREE_NODE_BYTES (7 * sizeof(uint32_t) + sizeof(uint64_t))
+
+// The call tree of a trace, rebuilt from the activity and parent ids of its
+// items. The trace is not in call order and activity ids repeat within a
+// state, so the parent of an item is the item with its parent id whose
+// function is the closest one at or below its caller address. A parent
+// must have a smaller activity id than its children, which keeps the tree
+// acyclic; items without a parent hang off a virtual root, node size().
+// Nodes are trace indices; children are kept in call (activity id) order.
+// Every node also carries a Merkle hash of its subtree, over the function
+// addresses, so equal hashes mean equal subtrees (up to collisions) and 
+// equal root hashes mean equal trees.
+class CallTree {
+  public:
+    CallTree() { }
+
+    void build(const FunctionTrace &trace);
+    void clear();
+
+    size_t size() const { return parent_.size(); }
+    uint32_t root() const { return parent_.size(); }
+
+    // CALL_TREE_NONE for the children of the root
+    uint32_t parent(uint32_t node) const { return parent_[node]; }
+    size_t child_count(uint32_t node) const
+    {
+      return child_begin_[node + 1] - child_begin_[node];
+    }
+    const uint32_t *children(uint32_t node) const
+    {
+      return children_.data() + child_begin_[node];
+    }
+    // The function ids of the children, for the diff kernels
+    const uint32_t *child_ids(uint32_t node) const
+    {
+      return child_ids_.data() + child_begin_[node];
+    }
+
+    // The nodes in pre-order; every subtree is a contiguous range of it
+    const std::vector<uint32_t> &preorder() const { return preorder_; }
+    uint32_t preorder_position(uint32_t node) const { return position_[node]; }
+    // Number of nodes in the subtree of node, including itself
+    uint32_t subtree_size(uint32_t node) const { return subtree_size_[node]; }
+    // The hash of the function of node and, in order, of its children
+    uint64_t hash(uint32_t node) const { return hash_[node]; }
+    uint64_t root_hash() const { return hash_[parent_.size()]; }
+
+    size_t memory_usage() const;
+
+  private:
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> child_begin_;  // size() + 2 offsets into children_
+    std::vector<uint32_t> children_;
+    std::vector<uint32_t> child_ids_;
+    std::vector<uint32_t> preorder_;
+    std::vector<uint32_t> position_;
+    std::vector<uint32_t> subtree_size_;
+    std::vector<uint64_t> hash_;  // size() + 1, with the root's
+};
+
+#endif /* VIOLET_LOG_ANALYZER_CALLTREE_H */
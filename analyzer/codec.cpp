@@ -0,0 +1,207 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "codec.h"
+
+#include <cmath>
+#include <cstring>
+
+enum TimeMode {TIME_MICROS = 0, TIME_RAW = 1};
+
+// Widths above this cannot be extracted from a single unaligned 64-bit
+// load, such columns are stored as raw 64-bit words instead
+static const int MAX_PACKED_WIDTH = 56;
+
+static inline uint64_t zigzag(int64_t v) { return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63); }
+static inline int64_t unzigzag(uint64_t v) { return (int64_t) (v >> 1) ^ -(int64_t) (v & 1); }
+
+static void put_varint(std::string *out, uint64_t v)
+{
+  while (v >= 0x80) {
+    out->push_back((char) (v | 0x80));
+    v >>= 7;
+  }
+  out->push_back((char) v);
+}
+
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    uint8_t byte = *(*p)++;
+    result |= (uint64_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline int bit_width(uint64_t v)
+{
+  return v == 0 ? 0 : 64 - __builtin_clzll(v);
+}
+
+static void put_column(std::string *out, const uint64_t *values, size_t n)
+{
+  uint64_t base = values[0], max = values[0];
+  for (size_t i = 1; i < n; ++i) {
+    if (values[i] < base) base = values[i];
+    if (values[i] > max) max = values[i];
+  }
+  int width = bit_width(max - base);
+  if (width > MAX_PACKED_WIDTH)
+    width = 64;
+  put_varint(out, base);
+  out->push_back((char) width);
+  if (width == 0)
+    return;
+  if (width == 64) {
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t v = values[i] - base;
+      out->append((const char *) &v, sizeof(v));
+    }
+    return;
+  }
+  size_t start = out->size();
+  size_t bytes = (n * width + 7) / 8;
+  // leave room to OR whole 64-bit words at the end, trimmed below
+  out->resize(start + bytes + sizeof(uint64_t), 0);
+  uint8_t *bits = (uint8_t *) &(*out)[start];
+  for (size_t i = 0; i < n; ++i) {
+    size_t pos = i * width;
+    uint64_t word;
+    memcpy(&word, bits + (pos >> 3), sizeof(word));
+    word |= (values[i] - base) << (pos & 7);
+    memcpy(bits + (pos >> 3), &word, sizeof(word));
+  }
+  out->resize(start + bytes);
+}
+
+static bool get_column(const uint8_t **p, const uint8_t *end, size_t n, uint64_t *values)
+{
+  uint64_t base;
+  if (!get_varint(p, end, &base) || *p >= end)
+    return false;
+  int width = *(*p)++;
+  if (width == 0) {
+    for (size_t i = 0; i < n; ++i)
+      values[i] = base;
+    return true;
+  }
+  if (width == 64) {
+    if ((size_t) (end - *p) < n * sizeof(uint64_t))
+      return false;
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t v;
+      memcpy(&v, *p + i * sizeof(v), sizeof(v));
+      values[i] = base + v;
+    }
+    *p += n * sizeof(uint64_t);
+    return true;
+  }
+  size_t bytes = (n * width + 7) / 8;
+  if (width > MAX_PACKED_WIDTH || (size_t) (end - *p) < bytes)
+    return false;
+  // every value lies within one unaligned 64-bit word; the padding after 
+  // the encoded data makes the loads at the end safe
+  const uint8_t *bits = *p;
+  const uint64_t mask = (1ULL << width) - 1;
+  for (size_t i = 0; i < n; ++i) {
+    size_t pos = i * width;
+    uint64_t word;
+    memcpy(&word, bits + (pos >> 3), sizeof(word));
+    values[i] = base + ((word >> (pos & 7)) & mask);
+  }
+  *p += bytes;
+  return true;
+}
+
+void encode_trace(const FunctionTrace &trace, AddressDictionary *dict,
+    std::string *out)
+{
+  uint64_t functions[TRACE_CODEC_BLOCK_SIZE], callers[TRACE_CODEC_BLOCK_SIZE];
+  uint64_t activities[TRACE_CODEC_BLOCK_SIZE], parents[TRACE_CODEC_BLOCK_SIZE];
+  uint64_t times[TRACE_CODEC_BLOCK_SIZE];
+  uint64_t prev_activity = 0;
+  for (size_t start = 0; start < trace.size(); start += TRACE_CODEC_BLOCK_SIZE) {
+    size_t n = trace.size() - start;
+    if (n > TRACE_CODEC_BLOCK_SIZE)
+      n = TRACE_CODEC_BLOCK_SIZE;
+    TimeMode mode = TIME_MICROS;
+    for (size_t i = 0; i < n; ++i) {
+      size_t idx = start + i;
+      functions[i] = dict->intern(trace.function(idx));
+      callers[i] = dict->intern(trace.caller(idx));
+      activities[i] = zigzag(trace.activity_id(idx) - prev_activity);
+      parents[i] = zigzag(trace.activity_id(idx) - trace.parent_id(idx));
+      prev_activity = trace.activity_id(idx);
+      double time = trace.execution_time(idx);
+      double micros = std::round(time * 1000);
+      if (mode == TIME_MICROS && micros >= 0 && micros < 9e15 && 
+          micros / 1000 == time && !std::signbit(time)) {
+        times[i] = (uint64_t) micros;
+      } else {
+        mode = TIME_RAW;
+      }
+    }
+    if (mode == TIME_RAW) {
+      for (size_t i = 0; i < n; ++i) {
+        double time = trace.execution_time(start + i);
+        memcpy(&times[i], &time, sizeof(time));
+      }
+    }
+    put_varint(out, n);
+    out->push_back((char) mode);
+    put_column(out, functions, n);
+    put_column(out, callers, n);
+    put_column(out, activities, n);
+    put_column(out, parents, n);
+    put_column(out, times, n);
+  }
+}
+
+bool decode_trace(const uint8_t *data, const uint8_t *end, size_t record_cnt,
+    const uint64_t *dict, size_t dict_size, FunctionTrace *trace)
+{
+  uint64_t functions[TRACE_CODEC_BLOCK_SIZE], callers[TRACE_CODEC_BLOCK_SIZE];
+  uint64_t activities[TRACE_CODEC_BLOCK_SIZE], parents[TRACE_CODEC_BLOCK_SIZE];
+  uint64_t times[TRACE_CODEC_BLOCK_SIZE];
+  uint64_t activity = 0;
+  trace->reserve(trace->size() + record_cnt);
+  while (record_cnt > 0) {
+    uint64_t n;
+    if (!get_varint(&data, end, &n) || n == 0 || n > TRACE_CODEC_BLOCK_SIZE || 
+        n > record_cnt || data >= end)
+      return false;
+    int mode = *data++;
+    if (!get_column(&data, end, n, functions) || !get_column(&data, end, n, callers) ||
+        !get_column(&data, end, n, activities) || !get_column(&data, end, n, parents) ||
+        !get_column(&data, end, n, times))
+      return false;
+    for (size_t i = 0; i < n; ++i) {
+      if (functions[i] >= dict_size || callers[i] >= dict_size)
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      activity += unzigzag(activities[i]);
+      double time;
+      if (mode == TIME_MICROS) {
+        time = times[i] / 1000.0;
+      } else {
+        memcpy(&time, &times[i], sizeof(time));
+      }
+      trace->push_back(dict[functions[i]], dict[callers[i]], activity,
+          activity - unzigzag(parents[i]), time);
+    }
+    record_cnt -= n;
+  }
+  return true;
+}
@@ -0,0 +1,47 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_CODEC_H
+#define VIOLET_LOG_ANALYZER_CODEC_H
+
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+// Compact encoding of a function trace. The trace is cut into blocks of
+// up to TRACE_CODEC_BLOCK_SIZE records, and each block stores five 
+// columns:
+//
+//   function, caller   index into the address dictionary of the file
+//   activity_id        zigzag delta to the previous record's activity id
+//   parent_id          zigzag delta between activity id and parent id
+//   execution_time     integer microseconds when every time in the block 
+//                      converts exactly, otherwise the raw double bits
+//
+// Each column is frame-of-reference coded: a varint base (the minimum 
+// value) and a bit width, followed by the bit-packed offsets from the base.
+// Decoding is lossless.
+
+#define TRACE_CODEC_BLOCK_SIZE 128
+
+// Bytes that must follow the encoded data so that the decoder can load
+// whole 64-bit words at the end of a column
+#define TRACE_CODEC_PADDING 8
+
+// Append the encoding of trace to out
+void encode_trace(const FunctionTrace &trace, AddressDictionary *dict,
+    std::string *out);
+
+// Decode record_cnt records from [data, end) and append them to trace.
+// The buffer must be followed by TRACE_CODEC_PADDING readable bytes.
+bool decode_trace(const uint8_t *data, const uint8_t *end, size_t record_cnt,
+    const uint64_t *dict, size_t dict_size, FunctionTrace *trace);
+
+#endif /* VIOLET_LOG_ANALYZER_CODEC_H */
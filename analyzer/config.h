@@ -11,17 +11,37 @@
 #ifndef VIOLET_LOG_ANALYZER_CONFIG_H
 #define VIOLET_LOG_ANALYZER_CONFIG_H
 
+#include <set>
+#include <stdint.h>
 #include <string>
+#include <vector>
+
+#include "diff.h"
 
 struct analyzer_config {
   bool append_output;
   std::string input_path;
+  // all inputs after glob expansion; input_path is the first one
+  std::vector<std::string> input_paths;
+  std::vector<std::string> constraint_paths;
   std::string executable_path;
   std::string symtable_path;
+  std::string symcache_dir;
+  std::string maps_path;
   std::string output_path;
   std::string outdir;
   std::string constraint_path;
   int max_ignored;
+  int jobs;
+  bool follow;
+  int follow_timeout;
+  DiffEngine diff_engine;
+  double tree_diff_threshold;  // in ms
+  int memory_budget;  // in MB, 0 for no limit
+  uint64_t load_base;
+  std::string convert_path;
+  bool compress;
+  std::set<int> states;
 };
 
 #endif  // VIOLET_LOG_ANALYZER_CONFIG_H
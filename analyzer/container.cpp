@@ -0,0 +1,264 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "container.h"
+#include "codec.h"
+
+#include <fstream>
+#include <vector>
+
+bool write_trace_container(const std::string &path, StateCostTable *table,
+    bool compress)
+{
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    std::cerr << "Unable to open file at " << path << std::endl;
+    return false;
+  }
+
+  // the packed traces have to be encoded first to know their offsets
+  AddressDictionary dict;
+  std::string packed;
+  std::vector<_traceContainerState> states;
+  uint64_t constraint_cnt = 0, record_cnt = 0;
+  for (auto it = table->begin(); it != table->end(); ++it) {
+    StateCostRecord &record = *it;
+    _traceContainerState state;
+    state.state_id = it->id;
+    state.instruction_count = record.instruction_count;
+    state.syscall_count = record.syscall_count;
+    state.execution_time = record.execution_time;
+    state.constraint_offset = constraint_cnt;
+    state.constraint_count = record.target_constraints.size() + record.constraints.size();
+    state.record_offset = compress ? packed.size() : record_cnt;
+    state.record_count = record.trace.size();
+    constraint_cnt += state.constraint_count;
+    record_cnt += state.record_count;
+    states.push_back(state);
+    if (compress)
+      encode_trace(record.trace, &dict, &packed);
+  }
+  packed.append(TRACE_CODEC_PADDING, '\0');
+
+  _traceContainerHeader header;
+  memcpy(header.magic, TRACE_CONTAINER_MAGIC, sizeof(header.magic));
+  header.version = compress ? TRACE_CONTAINER_PACKED_VERSION : TRACE_CONTAINER_VERSION;
+  header.section_count = compress ? 4 : 3;
+  _traceContainerSection sections[4];
+  sections[0].type = SECTION_STATE_INDEX;
+  sections[0].offset = sizeof(header) + header.section_count * sizeof(_traceContainerSection);
+  sections[0].size = states.size() * sizeof(_traceContainerState);
+  sections[1].type = SECTION_CONSTRAINTS;
+  sections[1].offset = sections[0].offset + sections[0].size;
+  sections[1].size = constraint_cnt * sizeof(_traceContainerConstraint);
+  if (compress) {
+    sections[2].type = SECTION_DICTIONARY;
+    sections[2].offset = sections[1].offset + sections[1].size;
+    sections[2].size = dict.addresses().size() * sizeof(uint64_t);
+    sections[3].type = SECTION_PACKED_TRACES;
+    sections[3].offset = sections[2].offset + sections[2].size;
+    sections[3].size = packed.size();
+  } else {
+    sections[2].type = SECTION_TRACES;
+    sections[2].offset = sections[1].offset + sections[1].size;
+    sections[2].size = record_cnt * sizeof(_traceContainerRecord);
+  }
+
+  out.write((const char *) &header, sizeof(header));
+  out.write((const char *) sections, header.section_count * sizeof(_traceContainerSection));
+  if (!states.empty())
+    out.write((const char *) &states[0], sections[0].size);
+
+  for (auto it = table->begin(); it != table->end(); ++it) {
+    const ConstraintTrace *lists[2] = {&it->target_constraints, 
+      &it->constraints};
+    for (int l = 0; l < 2; ++l) {
+      for (auto cit = lists[l]->begin(); cit != lists[l]->end(); ++cit) {
+        _traceContainerConstraint constraint;
+        constraint.variable_number = cit->variable_number;
+        constraint.value = cit->value;
+        constraint.is_target = cit->is_target;
+        out.write((const char *) &constraint, sizeof(constraint));
+      }
+    }
+  }
+
+  if (compress) {
+    if (!dict.addresses().empty())
+      out.write((const char *) &dict.addresses()[0], sections[2].size);
+    out.write(packed.data(), packed.size());
+  } else {
+    std::vector<_traceContainerRecord> buffer;
+    for (auto it = table->begin(); it != table->end(); ++it) {
+      const FunctionTrace &trace = it->trace;
+      buffer.resize(trace.size());
+      for (size_t i = 0; i < trace.size(); ++i) {
+        _traceContainerRecord &record = buffer[i];
+        record.function = trace.function(i);
+        record.caller = trace.caller(i);
+        record.activity_id = trace.activity_id(i);
+        record.parent_id = trace.parent_id(i);
+        record.execution_time = trace.execution_time(i);
+      }
+      if (!buffer.empty())
+        out.write((const char *) &buffer[0], buffer.size() * sizeof(_traceContainerRecord));
+    }
+  }
+  out.close();
+  if (!out) {
+    std::cerr << "Failed to write the trace container " << path << std::endl;
+    return false;
+  }
+  std::cout << "Wrote " << states.size() << " states and " << record_cnt 
+    << " trace records to " << path;
+  if (compress) {
+    std::cout << " (" << dict.addresses().size() << " distinct addresses, "
+      << (record_cnt > 0 ? (double) packed.size() / record_cnt : 0) 
+      << " bytes per record)";
+  }
+  std::cout << std::endl;
+  return true;
+}
+
+bool TraceContainerParser::is_container(const std::string &fileName)
+{
+  std::ifstream in(fileName, std::ios::in | std::ios::binary);
+  char magic[8];
+  if (!in.read(magic, sizeof(magic)))
+    return false;
+  return memcmp(magic, TRACE_CONTAINER_MAGIC, sizeof(magic)) == 0;
+}
+
+bool TraceContainerParser::parse(StateCostTable *table)
+{
+  MappedFile container;
+  if (!container.open(m_fileName)) {
+    std::cerr << "Unable to open file at " << m_fileName << std::endl;
+    return false;
+  }
+  const char *data = container.data();
+  size_t size = container.size();
+  const _traceContainerHeader *header = (const _traceContainerHeader *) data;
+  if (size < sizeof(*header) || memcmp(header->magic, TRACE_CONTAINER_MAGIC, 
+        sizeof(header->magic)) != 0) {
+    std::cerr << m_fileName << " is not a trace container" << std::endl;
+    return false;
+  }
+  if (header->version != TRACE_CONTAINER_VERSION && 
+      header->version != TRACE_CONTAINER_PACKED_VERSION) {
+    std::cerr << "Unsupported trace container version " << header->version << std::endl;
+    return false;
+  }
+  if (size < sizeof(*header) + header->section_count * sizeof(_traceContainerSection)) {
+    std::cerr << "Truncated trace container " << m_fileName << std::endl;
+    return false;
+  }
+
+  const _traceContainerSection *sections = (const _traceContainerSection *) (header + 1);
+  const _traceContainerState *states = NULL;
+  const _traceContainerConstraint *constraints = NULL;
+  const _traceContainerRecord *records = NULL;
+  const uint64_t *dict = NULL;
+  const uint8_t *packed = NULL;
+  uint64_t state_cnt = 0, constraint_cnt = 0, record_cnt = 0;
+  uint64_t dict_size = 0, packed_size = 0;
+  for (uint32_t i = 0; i < header->section_count; ++i) {
+    const _traceContainerSection &section = sections[i];
+    if (section.offset > size || section.size > size - section.offset) {
+      std::cerr << "Section " << section.type << " is out of bounds in " 
+        << m_fileName << std::endl;
+      return false;
+    }
+    const char *begin = data + section.offset;
+    if (section.type == SECTION_STATE_INDEX) {
+      states = (const _traceContainerState *) begin;
+      state_cnt = section.size / sizeof(_traceContainerState);
+    } else if (section.type == SECTION_CONSTRAINTS) {
+      constraints = (const _traceContainerConstraint *) begin;
+      constraint_cnt = section.size / sizeof(_traceContainerConstraint);
+    } else if (section.type == SECTION_TRACES) {
+      records = (const _traceContainerRecord *) begin;
+      record_cnt = section.size / sizeof(_traceContainerRecord);
+    } else if (section.type == SECTION_DICTIONARY) {
+      dict = (const uint64_t *) begin;
+      dict_size = section.size / sizeof(uint64_t);
+    } else if (section.type == SECTION_PACKED_TRACES) {
+      packed = (const uint8_t *) begin;
+      packed_size = section.size;
+    }
+  }
+
+  bool is_packed = header->version == TRACE_CONTAINER_PACKED_VERSION;
+  if (is_packed && packed_size < TRACE_CODEC_PADDING) {
+    std::cerr << "Missing packed trace section in " << m_fileName << std::endl;
+    return false;
+  }
+  uint64_t parsed_cnt = 0;
+  for (uint64_t s = 0; s < state_cnt; ++s) {
+    if (!StateCostTable::valid_id(states[s].state_id)) {
+      std::cerr << "Invalid state id " << states[s].state_id << " in " 
+        << m_fileName << std::endl;
+      return false;
+    }
+    if (m_states.empty() || m_states.count(states[s].state_id))
+      table->reserve(states[s].state_id + 1);
+  }
+  for (uint64_t s = 0; s < state_cnt; ++s) {
+    const _traceContainerState &state = states[s];
+    if (!m_states.empty() && !m_states.count(state.state_id))
+      continue;
+    if (state.constraint_offset > constraint_cnt || 
+        state.constraint_count > constraint_cnt - state.constraint_offset ||
+        (is_packed && state.record_offset > packed_size - TRACE_CODEC_PADDING) ||
+        (!is_packed && (state.record_offset > record_cnt ||
+          state.record_count > record_cnt - state.record_offset))) {
+      std::cerr << "State " << state.state_id << " is out of bounds in " 
+        << m_fileName << std::endl;
+      return false;
+    }
+    StateCostRecord &record = get_state_record(table, state.state_id);
+    record.instruction_count = state.instruction_count;
+    record.syscall_count = state.syscall_count;
+    record.execution_time = state.execution_time;
+
+    // only the pages holding this state's records are touched
+    const _traceContainerConstraint *cbegin = constraints + state.constraint_offset;
+    record.constraints.reserve(record.constraints.size() + state.constraint_count);
+    for (uint64_t i = 0; i < state.constraint_count; ++i) {
+      ConstraintItem item;
+      item.id = state.state_id;
+      item.variable_number = cbegin[i].variable_number;
+      item.value = cbegin[i].value;
+      item.is_target = cbegin[i].is_target;
+      add_constraint_item(table, item);
+    }
+    if (is_packed) {
+      if (!decode_trace(packed + state.record_offset, 
+            packed + packed_size - TRACE_CODEC_PADDING, state.record_count,
+            dict, dict_size, &record.trace)) {
+        std::cerr << "Corrupted trace of state " << state.state_id << " in "
+          << m_fileName << std::endl;
+        return false;
+      }
+    } else {
+      const _traceContainerRecord *rbegin = records + state.record_offset;
+      record.trace.reserve(state.record_count);
+      for (uint64_t i = 0; i < state.record_count; ++i) {
+        record.trace.push_back(rbegin[i].function, rbegin[i].caller, 
+            rbegin[i].activity_id, rbegin[i].parent_id, rbegin[i].execution_time);
+      }
+    }
+    parsed_cnt += state.record_count;
+    if (!spill_items(table, state.record_count))
+      return false;
+  }
+  std::cout << "Successfully loaded " << table->size() << " of " << state_cnt 
+    << " states (" << parsed_cnt << " trace records) from " << m_fileName << std::endl;
+  return true;
+}
@@ -0,0 +1,108 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_CONTAINER_H
+#define VIOLET_LOG_ANALYZER_CONTAINER_H
+
+#include <set>
+#include <string>
+#include "parser.h"
+
+// The indexed trace container keeps the traces and constraints of all
+// states in one file. The layout is
+//
+//   header | section table | state index | constraints | trace records
+//
+// The state index holds one summary per state, with the offsets of the 
+// state's constraints and trace records in their sections, so a state 
+// can be loaded without reading any other state. The records of a state
+// are stored contiguously in trace order.
+
+//
+// Version 2 containers store the trace records compressed with the trace
+// codec (see codec.h): the raw record section is replaced by an address 
+// dictionary and a packed trace section, and the record offset of a state
+// is the byte offset of its first block in the packed section.
+
+#define TRACE_CONTAINER_MAGIC "VIOLETTC"
+#define TRACE_CONTAINER_VERSION 1
+#define TRACE_CONTAINER_PACKED_VERSION 2
+
+enum TraceContainerSectionType {
+  SECTION_STATE_INDEX = 1,
+  SECTION_CONSTRAINTS = 2,
+  SECTION_TRACES = 3,
+  SECTION_DICTIONARY = 4,
+  SECTION_PACKED_TRACES = 5,
+};
+
+#pragma pack(push, 1)
+struct _traceContainerHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t section_count;
+};
+
+struct _traceContainerSection {
+  uint32_t type;
+  uint64_t offset;  // absolute file offset of the section
+  uint64_t size;    // size of the section in bytes
+};
+
+struct _traceContainerState {
+  int32_t state_id;
+  int32_t instruction_count;
+  int32_t syscall_count;
+  double execution_time;
+  uint64_t constraint_offset;  // index of the first constraint
+  uint64_t constraint_count;
+  uint64_t record_offset;      // index of the first trace record
+  uint64_t record_count;
+};
+
+struct _traceContainerConstraint {
+  int32_t variable_number;
+  int64_t value;
+  uint8_t is_target;
+};
+
+struct _traceContainerRecord {
+  uint64_t function;
+  uint64_t caller;
+  uint64_t activity_id;
+  uint64_t parent_id;
+  double execution_time;
+};
+#pragma pack(pop)
+
+// Write the states of the table to a trace container file. If compress is
+// set, the trace records are encoded with the trace codec.
+bool write_trace_container(const std::string &path, StateCostTable *table,
+    bool compress = false);
+
+// Parser of the trace container. If a state filter is given, only those 
+// states are loaded.
+class TraceContainerParser: public TraceParserBase {
+  public:
+    TraceContainerParser(const std::string &fileName, 
+        const std::set<int> &states = std::set<int>()):
+      TraceParserBase(fileName, ""), m_states(states)
+    {
+    }
+
+    bool parse(StateCostTable *table);
+
+    // Check if the file starts with the container magic
+    static bool is_container(const std::string &fileName);
+
+  private:
+    std::set<int> m_states;
+};
+
+#endif /* VIOLET_LOG_ANALYZER_CONTAINER_H */
@@ -0,0 +1,579 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "diff.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "calltree.h"
+
+using namespace std;
+
+bool parse_diff_engine(const string &name, DiffEngine *engine)
+{
+  if (name == "myers")
+    *engine = DIFF_ENGINE_MYERS;
+  else if (name == "gnu")
+    *engine = DIFF_ENGINE_GNU;
+  else if (name == "lcs")
+    *engine = DIFF_ENGINE_LCS;
+  else if (name == "tree")
+    *engine = DIFF_ENGINE_TREE;
+  else
+    return false;
+  return true;
+}
+
+size_t common_prefix(const uint32_t *a, const uint32_t *b, size_t n)
+{
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= n; i += 4) {
+    __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(va, vb));
+    if (mask != 0xFFFF)
+      return i + __builtin_ctz(~mask) / 4;
+  }
+#endif
+  while (i < n && a[i] == b[i])
+    i++;
+  return i;
+}
+
+size_t common_suffix(const uint32_t *a_end, const uint32_t *b_end, size_t n)
+{
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= n; i += 4) {
+    __m128i va = _mm_loadu_si128((const __m128i *) (a_end - i - 4));
+    __m128i vb = _mm_loadu_si128((const __m128i *) (b_end - i - 4));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(va, vb));
+    if (mask != 0xFFFF)
+      return i + __builtin_clz(~mask << 16) / 4;
+  }
+#endif
+  while (i < n && a_end[-1 - (ptrdiff_t) i] == b_end[-1 - (ptrdiff_t) i])
+    i++;
+  return i;
+}
+
+// Move the deletions of each run of changes before its insertions. A run
+// ends where the next edit is preceded by a common element.
+static void order_runs(vector<DiffEdit>::iterator begin, vector<DiffEdit>::iterator end)
+{
+  size_t x = 0, y = 0;
+  vector<DiffEdit>::iterator run = begin;
+  for (vector<DiffEdit>::iterator it = begin; it != end; ++it) {
+    size_t common = it->flag == DIFF_DEL ? it->position - x : it->position - y;
+    if (common > 0) {
+      stable_partition(run, it, [](const DiffEdit &edit) { return edit.flag == DIFF_DEL; });
+      run = it;
+    }
+    x += common;
+    y += common;
+    if (it->flag == DIFF_DEL)
+      x++;
+    else
+      y++;
+  }
+  stable_partition(run, end, [](const DiffEdit &edit) { return edit.flag == DIFF_DEL; });
+}
+
+// The greedy forward search, backtracked through the furthest reaching
+// x of every round. Takes O(D^2) memory.
+static void greedy_diff(const uint32_t *a, size_t n, const uint32_t *b, size_t m,
+    size_t base, vector<DiffEdit> *edits, size_t *peak_bytes)
+{
+  // v[offset + k] is the furthest x reached on diagonal k = x - y. Round
+  // d only moves the diagonals -d, -d + 2, .., d; their d + 1 values are
+  // kept for the backtracking, as 32-bit positions to halve the memory.
+  ptrdiff_t max = n + m;
+  ptrdiff_t offset = max + 1;
+  vector<ptrdiff_t> v(2 * max + 3, 0);
+  vector<vector<uint32_t> > history;
+  size_t history_bytes = 0;
+  ptrdiff_t d = 0;
+  for (bool done = false; !done; ++d) {
+    for (ptrdiff_t k = -d; k <= d; k += 2) {
+      ptrdiff_t x;
+      if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+        x = v[offset + k + 1];      // down: insert b[y]
+      else
+        x = v[offset + k - 1] + 1;  // right: delete a[x]
+      ptrdiff_t y = x - k;
+      while (x < (ptrdiff_t) n && y < (ptrdiff_t) m && a[x] == b[y]) {
+        x++;
+        y++;
+      }
+      v[offset + k] = x;
+      if (x >= (ptrdiff_t) n && y >= (ptrdiff_t) m)
+        done = true;
+    }
+    history.push_back(vector<uint32_t>(d + 1));
+    for (ptrdiff_t k = -d; k <= d; k += 2)
+      history.back()[(k + d) / 2] = v[offset + k];
+    history_bytes += (d + 1) * sizeof(uint32_t);
+  }
+  d--;
+
+  // walk back from (n, m)
+  size_t begin = edits->size();
+  ptrdiff_t x = n, y = m;
+  for (; d > 0; --d) {
+    // diagonal k of round d - 1 is at (k + d - 1) / 2
+    const vector<uint32_t> &prev = history[d - 1];
+    ptrdiff_t k = x - y;
+    bool down = k == -d || (k != d && prev[(k + d - 2) / 2] < prev[(k + d) / 2]);
+    ptrdiff_t prev_k = down ? k + 1 : k - 1;
+    ptrdiff_t prev_x = prev[(prev_k + d - 1) / 2];
+    ptrdiff_t prev_y = prev_x - prev_k;
+    if (down)
+      edits->push_back(DiffEdit(DIFF_ADD, base + prev_y));
+    else
+      edits->push_back(DiffEdit(DIFF_DEL, base + prev_x));
+    x = prev_x;
+    y = prev_y;
+  }
+  reverse(edits->begin() + begin, edits->end());
+  *peak_bytes = v.size() * sizeof(ptrdiff_t) + history_bytes;
+}
+
+// Myers' linear space refinement: find the middle snake of an optimal
+// path by searching from both ends at once, then diff the parts before
+// and after it. Only the two V arrays are kept, sized for the whole input
+// and shared by all sub-problems.
+struct LinearDiff {
+  const uint32_t *a;
+  const uint32_t *b;
+  vector<ptrdiff_t> forward;
+  vector<ptrdiff_t> backward;  // furthest x from the end, on reversed diagonals
+  ptrdiff_t offset;
+  vector<DiffEdit> *edits;
+
+  // Find the middle snake of a[a0, a1) and b[b0, b1), which must both be
+  // non-empty and differ in their first and last elements
+  void middle_snake(size_t a0, size_t a1, size_t b0, size_t b1,
+      size_t *x_begin, size_t *y_begin, size_t *x_end, size_t *y_end)
+  {
+    ptrdiff_t n = a1 - a0, m = b1 - b0;
+    ptrdiff_t delta = n - m;
+    bool odd = delta & 1;
+    ptrdiff_t *vf = &forward[offset];
+    ptrdiff_t *vb = &backward[offset];
+    vf[1] = 0;
+    vb[1] = 0;
+    for (ptrdiff_t d = 0; d <= (n + m + 1) / 2; ++d) {
+      for (ptrdiff_t k = -d; k <= d; k += 2) {
+        ptrdiff_t x = (k == -d || (k != d && vf[k - 1] < vf[k + 1])) ? vf[k + 1] : vf[k - 1] + 1;
+        ptrdiff_t y = x - k;
+        ptrdiff_t x0 = x, y0 = y;
+        while (x < n && y < m && a[a0 + x] == b[b0 + y]) {
+          x++;
+          y++;
+        }
+        vf[k] = x;
+        // diagonal k is diagonal delta - k from the end
+        ptrdiff_t c = delta - k;
+        if (odd && c >= -(d - 1) && c <= d - 1 && x + vb[c] >= n) {
+          *x_begin = a0 + x0;
+          *y_begin = b0 + y0;
+          *x_end = a0 + x;
+          *y_end = b0 + y;
+          return;
+        }
+      }
+      for (ptrdiff_t c = -d; c <= d; c += 2) {
+        ptrdiff_t x = (c == -d || (c != d && vb[c - 1] < vb[c + 1])) ? vb[c + 1] : vb[c - 1] + 1;
+        ptrdiff_t y = x - c;
+        ptrdiff_t x0 = x, y0 = y;
+        while (x < n && y < m && a[a1 - 1 - x] == b[b1 - 1 - y]) {
+          x++;
+          y++;
+        }
+        vb[c] = x;
+        ptrdiff_t k = delta - c;
+        if (!odd && k >= -d && k <= d && x + vf[k] >= n) {
+          *x_begin = a1 - x;
+          *y_begin = b1 - y;
+          *x_end = a1 - x0;
+          *y_end = b1 - y0;
+          return;
+        }
+      }
+    }
+    assert(false);
+  }
+
+  void diff(size_t a0, size_t a1, size_t b0, size_t b1)
+  {
+    while (a0 < a1 && b0 < b1 && a[a0] == b[b0]) {
+      a0++;
+      b0++;
+    }
+    while (a0 < a1 && b0 < b1 && a[a1 - 1] == b[b1 - 1]) {
+      a1--;
+      b1--;
+    }
+    if (a0 == a1 || b0 == b1) {
+      for (size_t i = a0; i < a1; ++i)
+        edits->push_back(DiffEdit(DIFF_DEL, i));
+      for (size_t j = b0; j < b1; ++j)
+        edits->push_back(DiffEdit(DIFF_ADD, j));
+      return;
+    }
+    // middle_snake always finds one; the values only keep the compiler
+    // quiet when its assertion is compiled out
+    size_t x_begin = a0, y_begin = b0, x_end = a1, y_end = b1;
+    middle_snake(a0, a1, b0, b1, &x_begin, &y_begin, &x_end, &y_end);
+    diff(a0, x_begin, b0, y_begin);
+    diff(x_end, a1, y_end, b1);
+  }
+};
+
+void myers_diff(const uint32_t *a, size_t n, const uint32_t *b, size_t m,
+    vector<DiffEdit> *edits, DiffStats *stats, size_t linear_space_threshold)
+{
+  // the common prefix and suffix are not part of the search
+  size_t prefix = common_prefix(a, b, min(n, m));
+  size_t suffix = common_suffix(a + n, b + m, min(n, m) - prefix);
+  size_t begin = edits->size();
+  bool linear_space = n + m - 2 * (prefix + suffix) > linear_space_threshold;
+  size_t peak_bytes = 0;
+  if (linear_space) {
+    LinearDiff diff;
+    diff.a = a;
+    diff.b = b;
+    diff.offset = (n + m + 1) / 2 + 1;
+    diff.forward.resize(2 * diff.offset + 1);
+    diff.backward.resize(2 * diff.offset + 1);
+    diff.edits = edits;
+    diff.diff(prefix, n - suffix, prefix, m - suffix);
+    peak_bytes = 2 * diff.forward.size() * sizeof(ptrdiff_t);
+  } else if (n == prefix + suffix || m == prefix + suffix) {
+    for (size_t i = prefix; i < n - suffix; ++i)
+      edits->push_back(DiffEdit(DIFF_DEL, i));
+    for (size_t j = prefix; j < m - suffix; ++j)
+      edits->push_back(DiffEdit(DIFF_ADD, j));
+  } else {
+    greedy_diff(a + prefix, n - prefix - suffix, b + prefix, m - prefix - suffix,
+        prefix, edits, &peak_bytes);
+  }
+  order_runs(edits->begin() + begin, edits->end());
+  if (stats != NULL) {
+    stats->linear_space = linear_space;
+    stats->bit_parallel = false;
+    stats->peak_bytes = peak_bytes;
+  }
+}
+
+// Hyyro's bit-parallel LCS over the rows of a, with one bit per element
+// of b in each row vector V: bit j - 1 of V_i is 0 exactly when the LCS of
+// a[0, i) and b[0, j) is one longer than that of a[0, i) and b[0, j - 1).
+// Row i is computed from row i - 1 with a few word operations per 64
+// elements of b:
+//
+//   U = V & match(a[i]);  V' = (V + U) | (V - U)
+//
+// All rows are kept, n * m bits, and the edit script is read back from
+// them.
+static void bit_parallel_diff(const uint32_t *a, size_t n, const uint32_t *b, size_t m,
+    size_t base, vector<DiffEdit> *edits, size_t *peak_bytes)
+{
+  size_t words = (m + 63) / 64;
+  // the match vectors of the distinct elements of b
+  uint32_t max_id = 0;
+  for (size_t j = 0; j < m; ++j)
+    max_id = max(max_id, b[j]);
+  vector<uint32_t> symbols(max_id + 1, INVALID_ADDRESS_ID);
+  vector<uint64_t> masks;
+  for (size_t j = 0; j < m; ++j) {
+    if (symbols[b[j]] == INVALID_ADDRESS_ID) {
+      symbols[b[j]] = masks.size() / words;
+      masks.resize(masks.size() + words, 0);
+    }
+    masks[symbols[b[j]] * words + j / 64] |= (uint64_t) 1 << (j % 64);
+  }
+
+  vector<uint64_t> rows(n * words);
+  vector<uint64_t> ones(words, ~(uint64_t) 0);
+  const uint64_t *prev = ones.data();
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t *row = &rows[i * words];
+    if (a[i] > max_id || symbols[a[i]] == INVALID_ADDRESS_ID) {
+      copy(prev, prev + words, row);
+    } else {
+      const uint64_t *match = &masks[symbols[a[i]] * words];
+      uint64_t carry = 0;
+      for (size_t w = 0; w < words; ++w) {
+        uint64_t v = prev[w];
+        uint64_t u = v & match[w];
+        uint64_t sum = v + u;
+        uint64_t carry_out = sum < v;
+        sum += carry;
+        carry = carry_out | (sum < carry);
+        row[w] = sum | (v - u);
+      }
+    }
+    prev = row;
+  }
+
+  // walk back from (n, m), preferring insertions, then matches
+  size_t begin = edits->size();
+  size_t i = n, j = m;
+  while (i > 0 || j > 0) {
+    const uint64_t *row = i > 0 ? &rows[(i - 1) * words] : ones.data();
+    if (j > 0 && (row[(j - 1) / 64] >> ((j - 1) % 64) & 1)) {
+      edits->push_back(DiffEdit(DIFF_ADD, base + --j));
+    } else if (j > 0 && a[i - 1] == b[j - 1]) {
+      i--;
+      j--;
+    } else {
+      edits->push_back(DiffEdit(DIFF_DEL, base + --i));
+    }
+  }
+  reverse(edits->begin() + begin, edits->end());
+  *peak_bytes = (rows.size() + masks.size() + ones.size()) * sizeof(uint64_t) + 
+    symbols.size() * sizeof(uint32_t);
+}
+
+void lcs_diff(const uint32_t *a, size_t n, const uint32_t *b, size_t m,
+    vector<DiffEdit> *edits, DiffStats *stats)
+{
+  size_t prefix = common_prefix(a, b, min(n, m));
+  size_t suffix = common_suffix(a + n, b + m, min(n, m) - prefix);
+  size_t rest_n = n - prefix - suffix, rest_m = m - prefix - suffix;
+  if (rest_n == 0 || rest_m == 0 || 
+      (double) rest_n * rest_m > DIFF_BIT_PARALLEL_MAX_CELLS) {
+    myers_diff(a, n, b, m, edits, stats);
+    return;
+  }
+  size_t begin = edits->size();
+  size_t peak_bytes;
+  bit_parallel_diff(a + prefix, rest_n, b + prefix, rest_m, prefix, edits, &peak_bytes);
+  order_runs(edits->begin() + begin, edits->end());
+  if (stats != NULL) {
+    stats->linear_space = false;
+    stats->bit_parallel = true;
+    stats->peak_bytes = peak_bytes;
+  }
+}
+
+void diff_function_traces(const FunctionTrace &first, const FunctionTrace &second,
+    DiffEngine engine, DiffTrace *diff_trace, DiffStats *stats)
+{
+  assert(first.has_function_ids() && second.has_function_ids());
+  assert(engine == DIFF_ENGINE_MYERS || engine == DIFF_ENGINE_LCS);
+  vector<DiffEdit> edits;
+  if (engine == DIFF_ENGINE_LCS) {
+    lcs_diff(first.function_ids().data(), first.size(), second.function_ids().data(),
+        second.size(), &edits, stats);
+  } else {
+    myers_diff(first.function_ids().data(), first.size(), second.function_ids().data(),
+        second.size(), &edits, stats);
+  }
+  diff_trace->reserve(diff_trace->size() + edits.size());
+  for (auto it = edits.begin(); it != edits.end(); ++it) {
+    FunctionTraceItem item(it->flag == DIFF_ADD ? second.base_item(it->position) :
+        first.base_item(it->position));
+    item.diff.flag = it->flag;
+    item.diff.position = it->position;
+    diff_trace->push_back(item);
+  }
+}
+
+// A pair of matched nodes whose child lists are still to be aligned
+struct TreeDiffPair {
+  uint32_t first;
+  uint32_t second;
+  bool skip;
+
+  TreeDiffPair(uint32_t first, uint32_t second, bool skip): first(first), 
+    second(second), skip(skip) { }
+};
+
+// Matched nodes with equal subtrees, which are not searched below
+static inline bool equal_subtrees(const CallTree &first_tree, uint32_t x,
+    const CallTree &second_tree, uint32_t y)
+{
+  return first_tree.hash(x) == second_tree.hash(y) &&
+    first_tree.subtree_size(x) == second_tree.subtree_size(y);
+}
+
+// The edit script between two call trees, in pre-order positions
+static void tree_edits(const FunctionTrace &first, const FunctionTrace &second,
+    const CallTree &first_tree, const CallTree &second_tree, double skip_threshold,
+    vector<DiffEdit> *script, DiffStats *stats)
+{
+  // the partner of every node, CALL_TREE_NONE if it is deleted or added;
+  // the descendants of equal subtrees are left unmatched
+  vector<uint32_t> first_match(first.size(), CALL_TREE_NONE);
+  vector<uint32_t> second_match(second.size(), CALL_TREE_NONE);
+  vector<TreeDiffPair> pending;
+  pending.push_back(TreeDiffPair(first_tree.root(), second_tree.root(), false));
+  vector<DiffEdit> edits;
+  // the matched children of a pair, as (index in a, index in b)
+  vector<pair<size_t, size_t>> matched;
+  size_t search_bytes = 0;
+  while (!pending.empty()) {
+    TreeDiffPair top = pending.back();
+    pending.pop_back();
+    const uint32_t *a = first_tree.child_ids(top.first);
+    const uint32_t *b = second_tree.child_ids(top.second);
+    size_t n = first_tree.child_count(top.first);
+    size_t m = second_tree.child_count(top.second);
+
+    matched.clear();
+    if (top.skip) {
+      size_t prefix = common_prefix(a, b, min(n, m));
+      size_t suffix = common_suffix(a + n, b + m, min(n, m) - prefix);
+      for (size_t i = 0; i < prefix; ++i)
+        matched.push_back(make_pair(i, i));
+      for (size_t i = 1; i <= suffix; ++i)
+        matched.push_back(make_pair(n - i, m - i));
+    } else {
+      DiffStats list_stats;
+      edits.clear();
+      myers_diff(a, n, b, m, &edits, &list_stats);
+      search_bytes = max(search_bytes, list_stats.peak_bytes);
+      stats->child_lists++;
+      size_t i = 0, j = 0;
+      for (auto it = edits.begin(); it != edits.end(); ++it) {
+        size_t &index = it->flag == DIFF_DEL ? i : j;
+        while (index < it->position)
+          matched.push_back(make_pair(i++, j++));
+        index++;
+      }
+      while (i < n && j < m)
+        matched.push_back(make_pair(i++, j++));
+    }
+
+    for (auto it = matched.begin(); it != matched.end(); ++it) {
+      uint32_t x = first_tree.children(top.first)[it->first];
+      uint32_t y = second_tree.children(top.second)[it->second];
+      first_match[x] = y;
+      second_match[y] = x;
+      if (first_tree.child_count(x) == 0 || second_tree.child_count(y) == 0)
+        continue;
+      if (equal_subtrees(first_tree, x, second_tree, y)) {
+        stats->pruned++;
+        continue;
+      }
+      bool skip = top.skip || 
+        fabs(second.execution_time(y) - first.execution_time(x)) < skip_threshold;
+      if (skip && !top.skip)
+        stats->skipped++;
+      pending.push_back(TreeDiffPair(x, y, skip));
+    }
+  }
+
+  // Matched children keep their order and an unmatched node takes its 
+  // subtree with it, so the matching is monotone in pre-order and one 
+  // merge turns it into an edit script. Equal subtrees are stepped over.
+  const vector<uint32_t> &first_order = first_tree.preorder();
+  const vector<uint32_t> &second_order = second_tree.preorder();
+  size_t i = 0, j = 0;
+  while (i < first_order.size() || j < second_order.size()) {
+    if (i < first_order.size() && first_match[first_order[i]] == CALL_TREE_NONE) {
+      script->push_back(DiffEdit(DIFF_DEL, i++));
+    } else if (j < second_order.size() && second_match[second_order[j]] == CALL_TREE_NONE) {
+      script->push_back(DiffEdit(DIFF_ADD, j++));
+    } else {
+      assert(i < first_order.size() && j < second_order.size());
+      uint32_t x = first_order[i], y = second_order[j];
+      assert(first_match[x] == y);
+      size_t step = equal_subtrees(first_tree, x, second_tree, y) ?
+        first_tree.subtree_size(x) : 1;
+      i += step;
+      j += step;
+    }
+  }
+  stats->peak_bytes = first_tree.memory_usage() + second_tree.memory_usage() +
+    (first_match.size() + second_match.size()) * sizeof(uint32_t) + search_bytes;
+}
+
+const vector<DiffEdit> *TreeDiffCache::find(uint64_t first_hash, uint64_t second_hash,
+    DiffStats *stats)
+{
+  lock_guard<mutex> lock(mutex_);
+  auto it = scripts_.find(make_pair(first_hash, second_hash));
+  if (it == scripts_.end())
+    return NULL;
+  hits_++;
+  *stats = it->second.second;
+  return &it->second.first;
+}
+
+void TreeDiffCache::insert(uint64_t first_hash, uint64_t second_hash,
+    const vector<DiffEdit> &edits, const DiffStats &stats)
+{
+  lock_guard<mutex> lock(mutex_);
+  if (edits_ + edits.size() > max_edits_)
+    return;
+  // a script computed concurrently by another thread is the same one
+  if (scripts_.emplace(make_pair(first_hash, second_hash), make_pair(edits, stats)).second)
+    edits_ += edits.size();
+}
+
+void TreeDiffCache::clear()
+{
+  lock_guard<mutex> lock(mutex_);
+  scripts_.clear();
+  edits_ = 0;
+  hits_ = 0;
+}
+
+void tree_diff(const FunctionTrace &first, const CallTree &first_tree, 
+    const FunctionTrace &second, const CallTree &second_tree,
+    double skip_threshold, DiffTrace *diff_trace, DiffOrder *order, DiffStats *stats,
+    TreeDiffCache *cache)
+{
+  assert(first_tree.size() == first.size() && second_tree.size() == second.size());
+  DiffStats tree_stats;
+  tree_stats.call_tree = true;
+  vector<DiffEdit> edits;
+  const vector<DiffEdit> *script = &edits;
+  uint64_t first_hash = first_tree.root_hash(), second_hash = second_tree.root_hash();
+  // the edit script of a pair of trees only depends on the latencies when
+  // subtrees are skipped
+  bool cacheable = cache != NULL && skip_threshold <= 0;
+  if (first_hash == second_hash && first.size() == second.size()) {
+    tree_stats.identical = true;
+  } else if (cacheable && (script = cache->find(first_hash, second_hash, &tree_stats)) != NULL) {
+    tree_stats.cached = true;
+  } else {
+    script = &edits;
+    tree_edits(first, second, first_tree, second_tree, skip_threshold, &edits, 
+        &tree_stats);
+    if (cacheable)
+      cache->insert(first_hash, second_hash, edits, tree_stats);
+  }
+
+  const vector<uint32_t> &first_order = first_tree.preorder();
+  const vector<uint32_t> &second_order = second_tree.preorder();
+  diff_trace->reserve(diff_trace->size() + script->size());
+  for (auto it = script->begin(); it != script->end(); ++it) {
+    FunctionTraceItem item(it->flag == DIFF_ADD ? 
+        second.base_item(second_order[it->position]) :
+        first.base_item(first_order[it->position]));
+    item.diff.flag = it->flag;
+    item.diff.position = it->position;
+    diff_trace->push_back(item);
+  }
+  if (stats != NULL)
+    *stats = tree_stats;
+  order->first = first_order.data();
+  order->second = second_order.data();
+}
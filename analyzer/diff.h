@@ -0,0 +1,166 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_DIFF_H
+#define VIOLET_LOG_ANALYZER_DIFF_H
+
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "calltree.h"
+#include "trace.h"
+
+// How the traces of two states are diffed
+enum DiffEngine {
+  DIFF_ENGINE_MYERS,  // in-process O(ND) diff over the function ids
+  DIFF_ENGINE_GNU,    // external diff -u over key files
+  DIFF_ENGINE_LCS,    // in-process bit-parallel LCS over the function ids
+  DIFF_ENGINE_TREE,   // in-process diff of the call trees, one child list at a time
+};
+
+// Parse an engine name (myers, gnu, lcs or tree); returns false if unknown
+bool parse_diff_engine(const std::string &name, DiffEngine *engine);
+
+// One step of an edit script: delete a[position] (DIFF_DEL) or insert
+// b[position] (DIFF_ADD)
+struct DiffEdit {
+  DiffChangeFlag flag;
+  size_t position;
+
+  DiffEdit(DiffChangeFlag flag, size_t position): flag(flag), position(position) { }
+};
+
+// Inputs with more elements than this (after the common prefix and suffix)
+// are diffed in linear space
+#define DIFF_LINEAR_SPACE_THRESHOLD 4096
+
+// Residuals with more cells (N * M) than this are left to myers_diff by
+// lcs_diff, the bit matrix would take N * M / 8 bytes
+#define DIFF_BIT_PARALLEL_MAX_CELLS (1ULL << 29)
+
+struct DiffStats {
+  bool linear_space;  // the linear space variant of Myers was used
+  bool bit_parallel;  // the bit-parallel LCS was used
+  bool call_tree;     // the call trees were diffed
+  bool identical;     // the call trees are equal, nothing was searched
+  bool cached;        // the edit script of an equal pair of trees was reused
+  size_t peak_bytes;  // working memory of the search
+  size_t child_lists; // child lists aligned by the tree diff
+  size_t skipped;     // subtrees the tree diff only trimmed
+  size_t pruned;      // equal subtrees the tree diff did not descend into
+
+  DiffStats(): linear_space(false), bit_parallel(false), call_tree(false),
+    identical(false), cached(false), peak_bytes(0), child_lists(0), skipped(0),
+    pruned(0) { }
+
+  const char *mode() const
+  {
+    return call_tree ? "call tree" : bit_parallel ? "bit-parallel LCS" : 
+      linear_space ? "linear space" : "greedy";
+  }
+};
+
+// The trace items that the positions of a diff refer to: position i of 
+// the first trace is item first[i]. Empty for the flat engines, whose 
+// positions are the item indices. The orders belong to the call trees
+// that were diffed.
+struct DiffOrder {
+  const uint32_t *first;
+  const uint32_t *second;
+
+  DiffOrder(): first(NULL), second(NULL) { }
+  bool empty() const { return first == NULL && second == NULL; }
+};
+
+// The length of the common prefix of a[0, n) and b[0, n), and of the
+// common suffix of the n elements before a_end and b_end. Compared four 
+// ids at a time with SSE2.
+size_t common_prefix(const uint32_t *a, const uint32_t *b, size_t n);
+size_t common_suffix(const uint32_t *a_end, const uint32_t *b_end, size_t n);
+
+// Compute a shortest edit script turning a into b with Myers' O((N+M)D)
+// algorithm. The greedy variant keeps the furthest reaching paths of every
+// round, O(D^2) memory; when N + M passes linear_space_threshold the 
+// divide and conquer variant, which bisects the problem at the middle 
+// snake, is used instead. It needs O(N+M) memory and, as its searches
+// from both ends only go half as deep, is not slower on real traces.
+// The edits are in order of position; in each run of changes between two
+// common elements the deletions come before the insertions, as in a
+// unified diff.
+void myers_diff(const uint32_t *a, size_t n, const uint32_t *b, size_t m,
+    std::vector<DiffEdit> *edits, DiffStats *stats = NULL, 
+    size_t linear_space_threshold = DIFF_LINEAR_SPACE_THRESHOLD);
+
+// Compute the same kind of edit script as myers_diff from a longest
+// common subsequence. After the common prefix and suffix are trimmed, the
+// LCS of the rest is found with a bit-parallel kernel in O(N * M / 64)
+// word operations, regardless of how different the inputs are. Residuals
+// above DIFF_BIT_PARALLEL_MAX_CELLS go to myers_diff.
+void lcs_diff(const uint32_t *a, size_t n, const uint32_t *b, size_t m,
+    std::vector<DiffEdit> *edits, DiffStats *stats = NULL);
+
+// Diff two traces by their function ids with an in-process engine (myers
+// or lcs) and append the added and deleted items, with their flag and 
+// position set, to diff_trace. The function ids of both traces must come
+// from the same dictionary.
+void diff_function_traces(const FunctionTrace &first, const FunctionTrace &second,
+    DiffEngine engine, DiffTrace *diff_trace, DiffStats *stats = NULL);
+
+// The edit scripts of tree diffs by the root hashes of their call trees,
+// so that states with equal call trees share their diffs. The stats of the
+// search are kept with each script, so a hit reports the same as a miss.
+// At most max_edits edits are kept; later scripts are not cached. Safe to
+// use from several threads; found scripts stay valid until clear.
+#define DIFF_TREE_CACHE_MAX_EDITS (1 << 22)
+
+class TreeDiffCache {
+  public:
+    explicit TreeDiffCache(size_t max_edits = DIFF_TREE_CACHE_MAX_EDITS): 
+      max_edits_(max_edits), edits_(0), hits_(0) { }
+
+    const std::vector<DiffEdit> *find(uint64_t first_hash, uint64_t second_hash,
+        DiffStats *stats);
+    void insert(uint64_t first_hash, uint64_t second_hash, 
+        const std::vector<DiffEdit> &edits, const DiffStats &stats);
+    void clear();
+
+    size_t hits() const { return hits_; }
+
+  private:
+    std::map<std::pair<uint64_t, uint64_t>,
+      std::pair<std::vector<DiffEdit>, DiffStats> > scripts_;
+    std::mutex mutex_;
+    size_t max_edits_;
+    size_t edits_;
+    size_t hits_;
+};
+
+// Diff two traces along their call trees instead of as flat sequences. The
+// children of the two roots are aligned by function id with myers_diff,
+// then the children of every matched pair, and so on down; an unmatched
+// node is deleted or added with its whole subtree. A pair whose execution
+// times differ by less than skip_threshold ms is not searched below: its 
+// descendants are matched by the common prefix and suffix of each child 
+// list only. Matched subtrees with equal Merkle hashes are not searched
+// at all, and neither are equal trees. The positions of the edits are 
+// pre-order positions, which order maps back to the items. Without a skip
+// threshold the edit script only depends on the two trees and is looked
+// up in, or added to, cache if one is given. The call trees of the traces
+// are built by the caller, once for all the pairs a trace is in, and must
+// outlive order.
+void tree_diff(const FunctionTrace &first, const CallTree &first_tree, 
+    const FunctionTrace &second, const CallTree &second_tree,
+    double skip_threshold, DiffTrace *diff_trace, DiffOrder *order, 
+    DiffStats *stats = NULL, TreeDiffCache *cache = NULL);
+
+#endif /* VIOLET_LOG_ANALYZER_DIFF_H */
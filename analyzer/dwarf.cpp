@@ -0,0 +1,485 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "dwarf.h"
+
+#include <algorithm>
+#include <elf.h>
+#include <string.h>
+#include <unordered_map>
+
+using namespace std;
+
+// the subset of the DWARF constants the line program decoder needs
+enum {
+  DW_LNS_copy = 1,
+  DW_LNS_advance_pc = 2,
+  DW_LNS_advance_line = 3,
+  DW_LNS_set_file = 4,
+  DW_LNS_const_add_pc = 8,
+  DW_LNS_fixed_advance_pc = 9,
+
+  DW_LNE_end_sequence = 1,
+  DW_LNE_set_address = 2,
+
+  DW_LNCT_path = 1,
+  DW_LNCT_directory_index = 2,
+
+  DW_FORM_block = 0x09,
+  DW_FORM_block1 = 0x0a,
+  DW_FORM_data1 = 0x0b,
+  DW_FORM_data2 = 0x05,
+  DW_FORM_data4 = 0x06,
+  DW_FORM_data8 = 0x07,
+  DW_FORM_data16 = 0x1e,
+  DW_FORM_string = 0x08,
+  DW_FORM_strp = 0x0e,
+  DW_FORM_udata = 0x0f,
+  DW_FORM_line_strp = 0x1f,
+};
+
+// A bounds checked cursor over a section. Reads past the end return 0
+// and set the error flag instead of touching memory out of bounds.
+struct DwarfReader {
+  const uint8_t *p;
+  const uint8_t *end;
+  bool error;
+
+  DwarfReader(const uint8_t *begin, const uint8_t *end): p(begin), end(end), error(false) { }
+
+  bool done() const { return error || p >= end; }
+
+  uint64_t fixed(size_t n)
+  {
+    if ((size_t) (end - p) < n) {
+      error = true;
+      p = end;
+      return 0;
+    }
+    uint64_t v = 0;
+    memcpy(&v, p, n);  // little endian only
+    p += n;
+    return v;
+  }
+
+  uint64_t uleb()
+  {
+    uint64_t v = 0;
+    for (int shift = 0; p < end; shift += 7) {
+      uint8_t byte = *p++;
+      if (shift < 64)
+        v |= (uint64_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return v;
+    }
+    error = true;
+    return 0;
+  }
+
+  int64_t sleb()
+  {
+    int64_t v = 0;
+    int shift = 0;
+    for (; p < end; ) {
+      uint8_t byte = *p++;
+      if (shift < 64)
+        v |= (int64_t) (byte & 0x7f) << shift;
+      shift += 7;
+      if (!(byte & 0x80)) {
+        if (shift < 64 && (byte & 0x40))
+          v |= -((int64_t) 1 << shift);
+        return v;
+      }
+    }
+    error = true;
+    return 0;
+  }
+
+  const char *str()
+  {
+    const uint8_t *nul = (const uint8_t *) memchr(p, '\0', end - p);
+    if (nul == NULL) {
+      error = true;
+      p = end;
+      return "";
+    }
+    const char *s = (const char *) p;
+    p = nul + 1;
+    return s;
+  }
+
+  void skip(uint64_t n)
+  {
+    if ((uint64_t) (end - p) < n) {
+      error = true;
+      p = end;
+    } else {
+      p += n;
+    }
+  }
+};
+
+struct DwarfSections {
+  const uint8_t *line, *line_end;
+  const uint8_t *str, *str_end;
+  const uint8_t *line_str, *line_str_end;
+};
+
+static const char *section_string(const uint8_t *begin, const uint8_t *end, uint64_t offset)
+{
+  if (begin == NULL || offset >= (uint64_t) (end - begin) ||
+      memchr(begin + offset, '\0', end - begin - offset) == NULL)
+    return "";
+  return (const char *) begin + offset;
+}
+
+// Read one attribute of a DWARF 5 directory or file entry. Strings are
+// returned in *s, numbers in *v.
+static void read_form(DwarfReader &r, uint64_t form, bool dwarf64,
+    const DwarfSections &sections, const char **s, uint64_t *v)
+{
+  *s = NULL;
+  *v = 0;
+  switch (form) {
+    case DW_FORM_string: *s = r.str(); break;
+    case DW_FORM_strp:
+      *s = section_string(sections.str, sections.str_end, r.fixed(dwarf64 ? 8 : 4));
+      break;
+    case DW_FORM_line_strp:
+      *s = section_string(sections.line_str, sections.line_str_end, r.fixed(dwarf64 ? 8 : 4));
+      break;
+    case DW_FORM_udata: *v = r.uleb(); break;
+    case DW_FORM_data1: *v = r.fixed(1); break;
+    case DW_FORM_data2: *v = r.fixed(2); break;
+    case DW_FORM_data4: *v = r.fixed(4); break;
+    case DW_FORM_data8: *v = r.fixed(8); break;
+    case DW_FORM_data16: r.skip(16); break;
+    case DW_FORM_block: r.skip(r.uleb()); break;
+    case DW_FORM_block1: r.skip(r.fixed(1)); break;
+    default:
+      // a form that cannot appear in a line table header
+      r.error = true;
+  }
+}
+
+static string join_path(const string &dir, const char *name)
+{
+  if (name[0] == '/' || dir.empty())
+    return name;
+  return dir + "/" + name;
+}
+
+// A decoded sequence: rows of (address, position), ending with a row of
+// line 0 at the end address
+typedef vector<pair<uint64_t, SourceLine> > LineSequence;
+
+class LineProgramDecoder {
+  public:
+    LineProgramDecoder(const DwarfSections &sections, vector<string> *file_names):
+      sections_(sections), file_names_(file_names) { }
+
+    // Decode the unit at r.p and append its sequences
+    bool decode_unit(DwarfReader &r, vector<LineSequence> *sequences);
+
+  private:
+    // Map the file of a unit to the global file table
+    uint32_t global_file(const string &path)
+    {
+      auto it = file_ids_.find(path);
+      if (it != file_ids_.end())
+        return it->second;
+      uint32_t id = file_names_->size();
+      file_names_->push_back(path);
+      file_ids_[path] = id;
+      return id;
+    }
+
+    bool read_entries_v5(DwarfReader &r, bool dwarf64, vector<string> &dirs,
+        vector<string> *paths);
+
+    const DwarfSections &sections_;
+    vector<string> *file_names_;
+    unordered_map<string, uint32_t> file_ids_;
+};
+
+bool LineProgramDecoder::read_entries_v5(DwarfReader &r, bool dwarf64,
+    vector<string> &dirs, vector<string> *paths)
+{
+  size_t format_cnt = r.fixed(1);
+  vector<pair<uint64_t, uint64_t> > formats;
+  for (size_t i = 0; i < format_cnt && !r.error; ++i) {
+    uint64_t type = r.uleb();
+    uint64_t form = r.uleb();
+    formats.push_back(make_pair(type, form));
+  }
+  uint64_t entry_cnt = r.uleb();
+  for (uint64_t i = 0; i < entry_cnt && !r.error; ++i) {
+    const char *name = "";
+    uint64_t dir = 0;
+    for (size_t f = 0; f < formats.size(); ++f) {
+      const char *s;
+      uint64_t v;
+      read_form(r, formats[f].second, dwarf64, sections_, &s, &v);
+      if (formats[f].first == DW_LNCT_path && s != NULL)
+        name = s;
+      else if (formats[f].first == DW_LNCT_directory_index)
+        dir = v;
+    }
+    // the directory table is read first, with no directory index
+    paths->push_back(&dirs == paths || dir >= dirs.size() ? string(name) :
+        join_path(dirs[dir], name));
+  }
+  return !r.error;
+}
+
+bool LineProgramDecoder::decode_unit(DwarfReader &r, vector<LineSequence> *sequences)
+{
+  bool dwarf64 = false;
+  uint64_t unit_length = r.fixed(4);
+  if (unit_length == 0xffffffff) {
+    dwarf64 = true;
+    unit_length = r.fixed(8);
+  }
+  if (r.error || unit_length > (uint64_t) (r.end - r.p))
+    return false;
+  const uint8_t *unit_end = r.p + unit_length;
+  DwarfReader unit(r.p, unit_end);
+  r.p = unit_end;
+
+  uint16_t version = unit.fixed(2);
+  if (version < 2 || version > 5)
+    return true;  // skip units we do not understand
+  uint8_t address_size = 8;
+  if (version >= 5) {
+    address_size = unit.fixed(1);
+    unit.fixed(1);  // segment selector size
+  }
+  uint64_t header_length = unit.fixed(dwarf64 ? 8 : 4);
+  if (unit.error || header_length > (uint64_t) (unit.end - unit.p))
+    return false;
+  const uint8_t *program = unit.p + header_length;
+  uint8_t min_inst_length = unit.fixed(1);
+  if (version >= 4)
+    unit.fixed(1);  // maximum operations per instruction, for VLIW only
+  unit.fixed(1);    // default is_stmt
+  int8_t line_base = (int8_t) unit.fixed(1);
+  uint8_t line_range = unit.fixed(1);
+  uint8_t opcode_base = unit.fixed(1);
+  if (line_range == 0 || opcode_base == 0)
+    return false;
+  vector<uint8_t> opcode_lengths(opcode_base, 0);
+  for (int i = 1; i < opcode_base; ++i)
+    opcode_lengths[i] = unit.fixed(1);
+
+  // file numbers start at 1 before DWARF 5 and at 0 since
+  vector<string> dirs, paths;
+  if (version >= 5) {
+    if (!read_entries_v5(unit, dwarf64, dirs, &dirs) ||
+        !read_entries_v5(unit, dwarf64, dirs, &paths))
+      return false;
+  } else {
+    dirs.push_back("");
+    for (const char *dir = unit.str(); *dir && !unit.error; dir = unit.str())
+      dirs.push_back(dir);
+    paths.push_back("");
+    for (const char *name = unit.str(); *name && !unit.error; name = unit.str()) {
+      uint64_t dir = unit.uleb();
+      unit.uleb();  // modification time
+      unit.uleb();  // file length
+      paths.push_back(dir < dirs.size() ? join_path(dirs[dir], name) : string(name));
+    }
+  }
+  if (unit.error)
+    return false;
+  vector<uint32_t> files(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i)
+    files[i] = global_file(paths[i]);
+
+  // run the line number program
+  unit.p = program;
+  uint64_t address = 0, file = 1, line = 1;
+  LineSequence sequence;
+  auto emit = [&](uint32_t row_line) {
+    SourceLine position;
+    position.file = file < files.size() ? files[file] : 0;
+    position.line = row_line;
+    sequence.push_back(make_pair(address, position));
+  };
+  while (!unit.done()) {
+    uint8_t opcode = unit.fixed(1);
+    if (opcode >= opcode_base) {
+      uint8_t adjusted = opcode - opcode_base;
+      address += (adjusted / line_range) * min_inst_length;
+      line += line_base + adjusted % line_range;
+      emit(line);
+    } else if (opcode == 0) {
+      uint64_t length = unit.uleb();
+      if (length == 0 || length > (uint64_t) (unit.end - unit.p))
+        break;
+      const uint8_t *next = unit.p + length;
+      uint8_t sub_opcode = unit.fixed(1);
+      if (sub_opcode == DW_LNE_end_sequence) {
+        emit(0);
+        // sequences of functions dropped by the linker are moved to 0
+        // or to -1 and carry no code of this binary
+        uint64_t start = sequence.front().first;
+        if (start != 0 && start != (uint64_t) -1 && start != 0xffffffff) {
+          sequences->push_back(LineSequence());
+          sequences->back().swap(sequence);
+        }
+        sequence.clear();
+        address = 0;
+        file = 1;
+        line = 1;
+      } else if (sub_opcode == DW_LNE_set_address) {
+        address = unit.fixed(length - 1 <= 8 ? length - 1 : address_size);
+      }
+      unit.p = next;
+    } else if (opcode == DW_LNS_copy) {
+      emit(line);
+    } else if (opcode == DW_LNS_advance_pc) {
+      address += unit.uleb() * min_inst_length;
+    } else if (opcode == DW_LNS_advance_line) {
+      line += unit.sleb();
+    } else if (opcode == DW_LNS_set_file) {
+      file = unit.uleb();
+    } else if (opcode == DW_LNS_const_add_pc) {
+      address += ((255 - opcode_base) / line_range) * min_inst_length;
+    } else if (opcode == DW_LNS_fixed_advance_pc) {
+      address += unit.fixed(2);
+    } else {
+      // column, is_stmt, basic block, prologue and epilogue markers, isa
+      // and unknown opcodes only have operands to skip
+      for (int i = 0; i < opcode_lengths[opcode]; ++i)
+        unit.uleb();
+    }
+  }
+  return true;
+}
+
+bool LineTable::load(const char *elf, size_t elf_size)
+{
+  clear();
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *) elf;
+  if (elf_size < sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+      ehdr->e_shentsize != sizeof(Elf64_Shdr) || ehdr->e_shoff > elf_size ||
+      ehdr->e_shnum > (elf_size - ehdr->e_shoff) / sizeof(Elf64_Shdr) ||
+      ehdr->e_shstrndx >= ehdr->e_shnum)
+    return false;
+  const Elf64_Shdr *shdrs = (const Elf64_Shdr *) (elf + ehdr->e_shoff);
+  const Elf64_Shdr &shstrtab = shdrs[ehdr->e_shstrndx];
+  if (shstrtab.sh_offset > elf_size || shstrtab.sh_size > elf_size - shstrtab.sh_offset)
+    return false;
+  const uint8_t *names = (const uint8_t *) elf + shstrtab.sh_offset;
+
+  DwarfSections sections;
+  memset(&sections, 0, sizeof(sections));
+  for (size_t i = 0; i < ehdr->e_shnum; ++i) {
+    const Elf64_Shdr &shdr = shdrs[i];
+    if (shdr.sh_type == SHT_NOBITS || shdr.sh_offset > elf_size ||
+        shdr.sh_size > elf_size - shdr.sh_offset || (shdr.sh_flags & SHF_COMPRESSED))
+      continue;
+    const char *name = section_string(names, names + shstrtab.sh_size, shdr.sh_name);
+    const uint8_t *begin = (const uint8_t *) elf + shdr.sh_offset;
+    const uint8_t *end = begin + shdr.sh_size;
+    if (strcmp(name, ".debug_line") == 0) {
+      sections.line = begin;
+      sections.line_end = end;
+    } else if (strcmp(name, ".debug_str") == 0) {
+      sections.str = begin;
+      sections.str_end = end;
+    } else if (strcmp(name, ".debug_line_str") == 0) {
+      sections.line_str = begin;
+      sections.line_str_end = end;
+    }
+  }
+  if (sections.line == NULL)
+    return false;
+
+  vector<LineSequence> sequences;
+  LineProgramDecoder decoder(sections, &file_names_);
+  DwarfReader r(sections.line, sections.line_end);
+  while (!r.done()) {
+    if (!decoder.decode_unit(r, &sequences))
+      break;
+  }
+
+  // sequences do not overlap, so ordering them by start address sorts
+  // the rows; the end row of a sequence stays before a sequence that
+  // starts at the same address
+  sort(sequences.begin(), sequences.end(), [](const LineSequence &a,
+        const LineSequence &b) { return a.front().first < b.front().first; });
+  size_t row_cnt = 0;
+  for (size_t i = 0; i < sequences.size(); ++i)
+    row_cnt += sequences[i].size();
+  addresses_.reserve(row_cnt);
+  lines_.reserve(row_cnt);
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    for (auto it = sequences[i].begin(); it != sequences[i].end(); ++it) {
+      // drop rows that would break the order when sequences overlap
+      if (!addresses_.empty() && it->first < addresses_.back())
+        continue;
+      addresses_.push_back(it->first);
+      lines_.push_back(it->second);
+    }
+  }
+  return !addresses_.empty();
+}
+
+void LineTable::clear()
+{
+  addresses_.clear();
+  lines_.clear();
+  file_names_.clear();
+}
+
+void LineTable::assign(vector<uint64_t> &addresses, vector<SourceLine> &lines,
+    vector<string> &file_names)
+{
+  addresses_.swap(addresses);
+  lines_.swap(lines);
+  file_names_.swap(file_names);
+}
+
+SourceLine LineTable::lookup(uint64_t address) const
+{
+  // the last row at or before address
+  auto it = upper_bound(addresses_.begin(), addresses_.end(), address);
+  if (it == addresses_.begin())
+    return SourceLine();
+  return lines_[it - addresses_.begin() - 1];
+}
+
+void LineTable::lookup_batch(const vector<uint64_t> &addresses,
+    vector<SourceLine> *lines) const
+{
+  vector<pair<uint64_t, size_t> > order(addresses.size());
+  for (size_t i = 0; i < addresses.size(); ++i)
+    order[i] = make_pair(addresses[i], i);
+  sort(order.begin(), order.end());
+
+  lines->assign(addresses.size(), SourceLine());
+  size_t row = 0, row_cnt = addresses_.size();
+  for (size_t i = 0; i < order.size(); ++i) {
+    uint64_t address = order[i].first;
+    // gallop forward to the first row after address, then search the
+    // last step; rows already passed are never looked at again
+    size_t step = 1, lo = row;
+    while (row < row_cnt && addresses_[row] <= address) {
+      lo = row;
+      row += step;
+      step *= 2;
+    }
+    row = upper_bound(addresses_.begin() + lo, addresses_.begin() + min(row, row_cnt),
+        address) - addresses_.begin();
+    if (row > 0)
+      (*lines)[order[i].second] = lines_[row - 1];
+  }
+}
@@ -0,0 +1,64 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_DWARF_H
+#define VIOLET_LOG_ANALYZER_DWARF_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A source position; line 0 means the position is unknown
+struct SourceLine {
+  uint32_t file;
+  uint32_t line;
+
+  SourceLine(): file(0), line(0) { }
+};
+
+// The address to line mapping of an executable, decoded from the line
+// number programs in its DWARF .debug_line section (versions 2 to 5). The 
+// rows of all sequences are kept in one array sorted by address; the end
+// of a sequence is a row with line 0, so addresses in gaps resolve to
+// nothing. File names relative to the compilation directory are kept
+// relative, as that directory is only recorded in .debug_info.
+class LineTable {
+  public:
+    LineTable() { }
+
+    // Decode the .debug_line section of a mapped ELF64 file. Returns false
+    // if the file has no line information.
+    bool load(const char *elf, size_t elf_size);
+    void clear();
+
+    size_t size() const { return addresses_.size(); }
+    bool empty() const { return addresses_.empty(); }
+
+    SourceLine lookup(uint64_t address) const;
+    // Resolve all addresses with one forward pass over the rows; the 
+    // addresses do not need to be sorted
+    void lookup_batch(const std::vector<uint64_t> &addresses,
+        std::vector<SourceLine> *lines) const;
+
+    const std::string &file_name(uint32_t file) const { return file_names_[file]; }
+
+    // The raw table, for the symbol cache
+    const std::vector<uint64_t> &row_addresses() const { return addresses_; }
+    const std::vector<SourceLine> &row_lines() const { return lines_; }
+    const std::vector<std::string> &file_names() const { return file_names_; }
+    void assign(std::vector<uint64_t> &addresses, std::vector<SourceLine> &lines,
+        std::vector<std::string> &file_names);
+
+  private:
+    std::vector<uint64_t> addresses_;
+    std::vector<SourceLine> lines_;
+    std::vector<std::string> file_names_;
+};
+
+#endif /* VIOLET_LOG_ANALYZER_DWARF_H */
@@ -0,0 +1,73 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "follow.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileWatcher::FileWatcher(const std::string &path, int poll_interval_ms):
+  poll_interval_ms_(poll_interval_ms), inotify_fd_(-1)
+{
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd >= 0) {
+    if (inotify_add_watch(fd, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  inotify_fd_ = fd;
+  paths_.push_back(path);
+  last_sizes_.push_back(0);
+}
+
+FileWatcher::~FileWatcher()
+{
+  if (inotify_fd_ >= 0)
+    close(inotify_fd_);
+}
+
+void FileWatcher::add(const std::string &path)
+{
+  // without a watch (e.g., the file is missing) the file is still checked
+  // every poll interval
+  if (inotify_fd_ >= 0)
+    inotify_add_watch(inotify_fd_, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE);
+  paths_.push_back(path);
+  last_sizes_.push_back(0);
+}
+
+bool FileWatcher::wait()
+{
+  if (inotify_fd_ >= 0) {
+    // the poll interval still bounds the wait so that the caller can 
+    // check for timeouts and interruption
+    struct pollfd pfd;
+    pfd.fd = inotify_fd_;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, poll_interval_ms_) > 0) {
+      char buf[4096];
+      // drain the queued events, the file sizes tell what changed
+      while (read(inotify_fd_, buf, sizeof(buf)) > 0) { }
+    }
+  } else {
+    usleep(poll_interval_ms_ * 1000);
+  }
+  bool grown = false;
+  for (size_t i = 0; i < paths_.size(); ++i) {
+    struct stat st;
+    if (stat(paths_[i].c_str(), &st) != 0)
+      continue;
+    grown = grown || st.st_size > last_sizes_[i];
+    last_sizes_[i] = st.st_size;
+  }
+  return grown;
+}
@@ -0,0 +1,45 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_FOLLOW_H
+#define VIOLET_LOG_ANALYZER_FOLLOW_H
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// Watch files that are still being written, e.g., the trace and constraint
+// files of a running S2E session. Uses inotify when available and falls
+// back to polling the file sizes otherwise.
+class FileWatcher {
+  public:
+    FileWatcher(const std::string &path, int poll_interval_ms = 1000);
+    ~FileWatcher();
+
+    // Also watch path. A file that does not exist yet is picked up by its
+    // size once it is created.
+    void add(const std::string &path);
+
+    // Block until a file grows, the poll interval elapses or a signal
+    // arrives. Returns true if any file has grown since the last call.
+    bool wait();
+
+    bool using_inotify() const { return inotify_fd_ >= 0; }
+
+  private:
+    FileWatcher(const FileWatcher &);
+    FileWatcher &operator=(const FileWatcher &);
+
+    std::vector<std::string> paths_;
+    std::vector<off_t> last_sizes_;
+    int poll_interval_ms_;
+    int inotify_fd_;
+};
+
+#endif /* VIOLET_LOG_ANALYZER_FOLLOW_H */
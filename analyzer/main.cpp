@@ -8,6 +8,5 @@
 //
 
 #include "analyzer.h"
-#include "dtl/dtl.hpp"
 
 int main(int argc, char **argv) { return analyzer_main(argc, argv); }
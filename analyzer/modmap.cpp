@@ -0,0 +1,180 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "modmap.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <elf.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+using namespace std;
+
+// An executable mapping of a module in the maps snapshot
+struct ModuleMapping {
+  uint64_t start;
+  uint64_t end;
+  uint64_t offset;  // file offset of start
+};
+
+// Compute the load bias of an ELF file from one of its mappings: the 
+// loadable segment that contains the mapped file offset tells the link
+// time address of the mapping start.
+static bool elf_load_bias(const MappedFile &elf, const ModuleMapping &mapping, 
+    uint64_t *bias)
+{
+  const char *data = elf.data();
+  size_t size = elf.size();
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *) data;
+  if (size < sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_phentsize != sizeof(Elf64_Phdr) ||
+      ehdr->e_phoff > size || ehdr->e_phnum > (size - ehdr->e_phoff) / sizeof(Elf64_Phdr))
+    return false;
+  const Elf64_Phdr *segments = (const Elf64_Phdr *) (data + ehdr->e_phoff);
+  for (size_t i = 0; i < ehdr->e_phnum; ++i) {
+    const Elf64_Phdr &segment = segments[i];
+    if (segment.p_type != PT_LOAD)
+      continue;
+    // the mapping starts at the page that contains the segment start
+    uint64_t page_offset = segment.p_offset & ~(uint64_t) 0xfff;
+    if (mapping.offset >= page_offset && 
+        mapping.offset < segment.p_offset + segment.p_filesz) {
+      uint64_t vaddr = segment.p_vaddr - (segment.p_offset - mapping.offset);
+      *bias = mapping.start - vaddr;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool load_module(Module *module, const ModuleMapping &mapping, 
+    const string &cache_dir)
+{
+  SymbolTable *symbols = new SymbolTable();
+  module->symbols.reset(symbols);
+  string cache_file, cache_key;
+  if (!cache_dir.empty()) {
+    cache_file = cache_dir + "/" + SymbolTable::cache_file_name(module->path);
+    cache_key = SymbolTable::cache_key(module->path);
+  }
+  if (cache_key.empty() || !SymbolTable::load_cache(cache_file, cache_key, symbols)) {
+    if (!SymbolTable::parse_elf(module->path, symbols))
+      return false;
+    if (!cache_key.empty())
+      symbols->save_cache(cache_file, cache_key);
+  }
+  MappedFile elf;
+  if (!elf.open(module->path) || !elf_load_bias(elf, mapping, &module->bias)) {
+    cerr << "Failed to find the load address of " << module->path << endl;
+    return false;
+  }
+  symbols->set_load_base(module->bias);
+  return true;
+}
+
+bool ModuleMap::load(const string &maps_file, int num_threads, const string &cache_dir)
+{
+  ifstream maps(maps_file);
+  if (!maps.is_open()) {
+    cerr << "Unable to open the maps file " << maps_file << endl;
+    return false;
+  }
+  // the executable mappings of each module, in the order modules appear
+  map<string, size_t> module_ids;
+  vector<vector<ModuleMapping> > mappings;
+  string line;
+  while (getline(maps, line)) {
+    ModuleMapping mapping;
+    char perms[8];
+    int path_pos = -1;
+    if (sscanf(line.c_str(), "%" SCNx64 "-%" SCNx64 " %7s %" SCNx64 " %*s %*s %n", &mapping.start, 
+          &mapping.end, perms, &mapping.offset, &path_pos) < 4 || path_pos < 0)
+      continue;
+    string path = line.substr(path_pos);
+    trim(path);
+    const char *deleted = " (deleted)";
+    if (path.size() > strlen(deleted) && 
+        path.compare(path.size() - strlen(deleted), string::npos, deleted) == 0)
+      path.erase(path.size() - strlen(deleted));
+    // skip data mappings and the pseudo files like [vdso]
+    if (strchr(perms, 'x') == NULL || path.empty() || path[0] != '/')
+      continue;
+    auto mit = module_ids.find(path);
+    if (mit == module_ids.end()) {
+      mit = module_ids.insert(make_pair(path, modules_.size())).first;
+      Module *module = new Module();
+      module->path = path;
+      module->name = path.substr(path.find_last_of('/') + 1);
+      module->start = mapping.start;
+      module->end = mapping.end;
+      module->bias = 0;
+      modules_.push_back(unique_ptr<Module>(module));
+      mappings.push_back(vector<ModuleMapping>());
+    }
+    Module *module = modules_[mit->second].get();
+    module->start = min(module->start, mapping.start);
+    module->end = max(module->end, mapping.end);
+    mappings[mit->second].push_back(mapping);
+  }
+
+  // the modules are independent, so their symbols are loaded in parallel
+  size_t module_cnt = modules_.size();
+  vector<char> loaded(module_cnt, 0);
+  atomic<size_t> next(0);
+  auto load_modules = [&]() {
+    for (size_t i = next++; i < module_cnt; i = next++)
+      loaded[i] = load_module(modules_[i].get(), mappings[i][0], cache_dir);
+  };
+  size_t worker_cnt = min(module_cnt, (size_t) max(num_threads, 1));
+  vector<thread> workers;
+  for (size_t w = 1; w < worker_cnt; ++w)
+    workers.push_back(thread(load_modules));
+  load_modules();
+  for (size_t w = 0; w < workers.size(); ++w)
+    workers[w].join();
+
+  vector<unique_ptr<Module> > modules;
+  ranges_.clear();
+  for (size_t i = 0; i < module_cnt; ++i) {
+    if (!loaded[i]) {
+      cerr << "Skipping module " << modules_[i]->path << endl;
+      continue;
+    }
+    for (auto it = mappings[i].begin(); it != mappings[i].end(); ++it) {
+      Range range = {it->start, it->end, modules.size()};
+      ranges_.push_back(range);
+    }
+    modules.push_back(std::move(modules_[i]));
+  }
+  modules_.swap(modules);
+  sort(ranges_.begin(), ranges_.end(), [](const Range &a, const Range &b) {
+      return a.start < b.start; });
+  return true;
+}
+
+struct obj_symbol *ModuleMap::resolve(uint64_t pc, uint64_t *offset, Module **module)
+{
+  // the last mapping that starts at or before pc
+  auto rit = upper_bound(ranges_.begin(), ranges_.end(), pc, 
+      [](uint64_t pc, const Range &range) { return pc < range.start; });
+  if (rit == ranges_.begin() || pc >= (rit - 1)->end)
+    return NULL;
+  Module *m = modules_[(rit - 1)->module].get();
+  struct obj_symbol *symbol = m->symbols->resolve(pc, offset);
+  if (symbol != NULL && module != NULL)
+    *module = m;
+  return symbol;
+}
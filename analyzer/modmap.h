@@ -0,0 +1,66 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_MODMAP_H
+#define VIOLET_LOG_ANALYZER_MODMAP_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "symtable.h"
+
+// A shared library or executable mapped into the traced process
+struct Module {
+  std::string path;
+  std::string name;   // file name of the path
+  uint64_t start;     // lowest and highest executable address
+  uint64_t end;
+  uint64_t bias;      // runtime address - link time address
+  std::unique_ptr<SymbolTable> symbols;
+};
+
+// The modules of a process, as described by a snapshot of its
+// /proc/pid/maps. Addresses are resolved by finding the module whose
+// executable mappings cover them, then the symbol in that module.
+class ModuleMap {
+  public:
+    ModuleMap() { }
+
+    // Parse the maps snapshot and load the symbols of every module that
+    // has executable mappings, num_threads modules at a time. Modules 
+    // whose symbols cannot be read are left out. The symbol tables are 
+    // cached in cache_dir if it is not empty.
+    bool load(const std::string &maps_file, int num_threads, 
+        const std::string &cache_dir);
+
+    size_t size() const { return modules_.size(); }
+    bool empty() const { return modules_.empty(); }
+    const Module &module(size_t i) const { return *modules_[i]; }
+
+    // Find the module containing the runtime address pc and the function
+    // in it. Returns NULL if no loaded module covers pc.
+    struct obj_symbol *resolve(uint64_t pc, uint64_t *offset, Module **module);
+
+  private:
+    ModuleMap(const ModuleMap &);
+    ModuleMap &operator=(const ModuleMap &);
+
+    // an executable mapping, sorted by start
+    struct Range {
+      uint64_t start;
+      uint64_t end;
+      size_t module;
+    };
+
+    std::vector<std::unique_ptr<Module> > modules_;
+    std::vector<Range> ranges_;
+};
+
+#endif /* VIOLET_LOG_ANALYZER_MODMAP_H */
@@ -10,60 +10,176 @@
 //
 
 #include "parser.h"
+#include "scanner.h"
 
+#include <algorithm>
 #include <fstream>
 #include <assert.h>
 #include <iomanip>
+#include <chrono>
+#include <thread>
+
+StateCostRecord &TraceParserBase::get_state_record(StateCostTable *table,
+    int state_id)
+{
+  return (*table)[state_id];
+}
 
 void TraceParserBase::add_trace_item(StateCostTable *table, int state_id, 
     FunctionTraceItem &item)
 {
-  if (!table->count(state_id)) {
-    StateCostRecord record;
-    record.syscall_count = 0;
-    record.instruction_count = 0;
-    record.id = state_id;
-    if (item.activity_id == 0) { // 0x0
-      record.execution_time = item.execution_time;
-    } else {
-      record.execution_time = 0;
-    }
-    record.trace.push_back(item);
-    (*table)[state_id] = record;
-  } else {
-    assert(table->count(state_id) == 1);
-    StateCostRecord &record = (*table)[state_id];
-    record.id = state_id;
-    if (item.activity_id == 0) { // 0x0
-      record.execution_time += item.execution_time;
-    }
-    record.trace.push_back(item);
+  StateCostRecord &record = get_state_record(table, state_id);
+  if (item.activity_id == 0) { // 0x0
+    record.execution_time += item.execution_time;
   }
+  record.trace.push_back(item);
 }
 
 void TraceParserBase::add_constraint_item(StateCostTable *table,ConstraintItem &item)
 {
-  if (!table->count(item.id)) {
-    StateCostRecord record;
-    if (item.is_target)
-      record.target_constraints.push_back(item);
-    else
-      record.constraints.push_back(item);
-    (*table)[item.id] = record;
-  } else {
-    assert(table->count(item.id) == 1);
-    StateCostRecord &record = (*table)[item.id];
-    if (item.is_target)
-      record.target_constraints.push_back(item);
-    else
-      record.constraints.push_back(item);
+  StateCostRecord &record = get_state_record(table, item.id);
+  if (item.is_target)
+    record.target_constraints.push_back(item);
+  else
+    record.constraints.push_back(item);
+}
+
+bool TraceParserBase::spill_items(StateCostTable *table, size_t n)
+{
+  m_unspilledItems += n;
+  // the columns can have twice the capacity they use
+  if (m_spillStore == NULL || 
+      m_unspilledItems * 2 * 5 * sizeof(uint64_t) <= m_spillBudget)
+    return true;
+  return spill_traces(table);
+}
+
+bool TraceParserBase::spill_traces(StateCostTable *table)
+{
+  // the function dictionary must know every function, as the spilled
+  // traces are given their ids again when they are loaded
+  table->intern_functions();
+  for (StateCostTable::iterator it = table->begin(); it != table->end(); ++it) {
+    if (!it->trace.empty() && !m_spillStore->evict(&*it))
+      return false;
   }
+  m_unspilledItems = 0;
+  m_spilled = true;
+  return true;
+}
+
+bool TraceParserBase::finish_spill(StateCostTable *table)
+{
+  return !m_spilled || spill_traces(table);
+}
+
+bool TraceParserBase::parse_incremental(StateCostTable *table, 
+    std::set<int> *changed_states)
+{
+  std::cerr << "Incremental parsing is not supported for " << m_fileName << std::endl;
+  return false;
 }
 
 bool TraceLogParser::parse(StateCostTable *table)
+{
+  MappedFile s2e_log;
+  if (!s2e_log.open(m_fileName)) {
+    return parse_stream(table);
+  }
+
+  return parse_range(table, s2e_log.data(), s2e_log.data() + s2e_log.size(), NULL);
+}
+
+bool TraceLogParser::parse_incremental(StateCostTable *table, 
+    std::set<int> *changed_states)
+{
+  MappedFile s2e_log;
+  if (!s2e_log.open(m_fileName)) {
+    std::cerr << "Unable to open file at " << m_fileName << std::endl;
+    return false;
+  }
+  if (s2e_log.size() < m_offset) {
+    std::cerr << m_fileName << " was truncated while following it" << std::endl;
+    return false;
+  }
+  // only consume complete lines, the last one may still be being written
+  const char *begin = s2e_log.data() + m_offset;
+  const char *nl = (const char *) memrchr(begin, '\n', s2e_log.size() - m_offset);
+  if (nl == NULL)
+    return true;
+  if (!parse_range(table, begin, nl + 1, changed_states))
+    return false;
+  m_offset += nl + 1 - begin;
+  return true;
+}
+
+bool TraceLogParser::parse_range(StateCostTable *table, const char *data,
+    const char *data_end, std::set<int> *changed_states)
+{
+  if (m_spillStore == NULL)
+    return parse_window(table, data, data_end, changed_states);
+  // the parsed events of a window are held until they are applied, so
+  // when spilling, the log is parsed a window of about the budget at a time
+  size_t window = std::max(m_spillBudget, (size_t) 1 << 20);
+  while (data < data_end) {
+    const char *end = data_end;
+    if ((size_t) (data_end - data) > window) {
+      const char *nl = (const char *) memchr(data + window, '\n', 
+          data_end - data - window);
+      end = nl == NULL ? data_end : nl + 1;
+    }
+    if (!parse_window(table, data, end, changed_states))
+      return false;
+    data = end;
+  }
+  return true;
+}
+
+bool TraceLogParser::parse_window(StateCostTable *table, const char *data,
+    const char *data_end, std::set<int> *changed_states)
+{
+  size_t size = data_end - data;
+  size_t num_chunks = m_numThreads > 1 ? m_numThreads : 1;
+  // don't bother splitting small logs
+  if (size < num_chunks * 4096)
+    num_chunks = 1;
+
+  // split the log at the newlines that follow each even split point
+  std::vector<const char *> bounds;
+  bounds.push_back(data);
+  for (size_t i = 1; i < num_chunks; ++i) {
+    const char *split = data + size / num_chunks * i;
+    if (split < bounds.back())
+      split = bounds.back();
+    const char *nl = (const char *) memchr(split, '\n', data_end - split);
+    bounds.push_back(nl == NULL ? data_end : nl + 1);
+  }
+  bounds.push_back(data_end);
+
+  std::vector<LogEventList> chunk_events(num_chunks);
+  if (num_chunks == 1) {
+    parse_chunk(bounds[0], bounds[1], &chunk_events[0]);
+  } else {
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < num_chunks; ++i) {
+      workers.push_back(std::thread(parse_chunk, bounds[i], bounds[i + 1], 
+            &chunk_events[i]));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+      workers[i].join();
+    }
+  }
+  for (size_t i = 0; i < num_chunks; ++i) {
+    if (!apply_events(table, chunk_events[i], changed_states))
+      return false;
+    LogEventList().swap(chunk_events[i]);
+  }
+  return true;
+}
+
+bool TraceLogParser::parse_stream(StateCostTable *table)
 {
   std::string line;
-  std::string expression = "LatencyTracker: Function";
   std::ifstream s2e_log(m_fileName);
 
   if (!s2e_log.is_open()) {
@@ -71,51 +187,78 @@ bool TraceLogParser::parse(StateCostTable *table)
     return false;
   }
 
+  LogEventList events;
   while (s2e_log.good()) {
-    int id;
     getline(s2e_log, line);
-    if (is_case_result(line)) {
-      id = get_state_id(line);
-      int instructions = stoi(get_count(line, "instruction"));
-      int syscalls = stoi(get_count(line, "syscall"));
-      if (!table->count(id)) {
-        StateCostRecord record;
-        record.syscall_count = syscalls;
-        record.instruction_count = instructions;
-        record.id = id;
-        record.execution_time = 0;
-        (*table)[id] = record;
-      } else {
-        assert(table->count(id) == 1);
-        StateCostRecord &record = (*table)[id];
-        assert(record.syscall_count == 0);
-        assert(record.instruction_count == 0);
-        record.syscall_count = syscalls;
-        record.instruction_count = instructions;
-      }
-    }
-
-    if (line.find(expression) != std::string::npos) {
-      id = get_state_id(line);
-      FunctionTraceItem item;
-      item.activity_id = s2f<uint64_t>(get_address(line, "activityId"));
-      item.parent_id = s2f<uint64_t>(get_address(line, "parentId"));
-      item.function = s2f<uint64_t>(get_address(line, "Function"));
-      item.caller = s2f<uint64_t>(get_address(line, "caller"));
-      item.execution_time = s2f<double>(get_execution_time(line, "runs"));
-      add_trace_item(table, id, item);
-    }
+    parse_line(line.data(), line.data() + line.size(), events);
+    if (!apply_events(table, events, NULL))
+      return false;
+    events.clear();
   }
   s2e_log.close();
   return true;
 }
 
-bool TraceLogParser::is_case_result(const std::string &line) {
-  std::string expression = "TestCaseGenerator: generating test case at address";
-  if (line.find(expression) != std::string::npos)
-    return true;
-  else
-    return false;
+void TraceLogParser::parse_chunk(const char *begin, const char *end, 
+    LogEventList *events)
+{
+  while (begin < end) {
+    const char *nl = (const char *) memchr(begin, '\n', end - begin);
+    if (nl == NULL)
+      nl = end;
+    parse_line(begin, nl, *events);
+    begin = nl + 1;
+  }
+}
+
+void TraceLogParser::parse_line(const char *begin, const char *end, 
+    LogEventList &events)
+{
+  LogEvent event;
+  switch (LogLineScanner::classify(begin, end)) {
+    case LOG_LINE_LATENCY:
+      if (LogLineScanner::scan_function_line(begin, end, &event.state_id, &event.item)) {
+        event.is_case_result = false;
+        events.push_back(event);
+      }
+      break;
+    case LOG_LINE_CASE:
+      if (LogLineScanner::scan_case_line(begin, end, &event.state_id,
+            &event.instructions, &event.syscalls)) {
+        event.is_case_result = true;
+        events.push_back(event);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+bool TraceLogParser::apply_events(StateCostTable *table, const LogEventList &events,
+    std::set<int> *changed_states)
+{
+  size_t item_cnt = 0;
+  for (auto eit = events.begin(); eit != events.end(); ++eit) {
+    if (!StateCostTable::valid_id(eit->state_id)) {
+      std::cerr << "Invalid state id " << eit->state_id << " in " << m_fileName 
+        << std::endl;
+      return false;
+    }
+    if (changed_states != NULL)
+      changed_states->insert(eit->state_id);
+    if (eit->is_case_result) {
+      StateCostRecord &record = get_state_record(table, eit->state_id);
+      assert(record.syscall_count == 0);
+      assert(record.instruction_count == 0);
+      record.syscall_count = eit->syscalls;
+      record.instruction_count = eit->instructions;
+    } else {
+      FunctionTraceItem item(eit->item);
+      add_trace_item(table, eit->state_id, item);
+      item_cnt++;
+    }
+  }
+  return spill_items(table, item_cnt);
 }
 
 size_t TraceLogParser::get_position(const std::string &filter, const std::string &line) {
@@ -153,25 +296,119 @@ std::string TraceLogParser::get_address(const std::string &line, std::string nam
   return get_count_base(line, name, ';');
 }
 
-std::string TraceLogParser::get_count(const std::string &line, std::string name) {
-  return get_count_base(line, name, ';');
+bool TraceDatParser::parse(StateCostTable *table)
+{
+  // do a sanity check on the struct size before deserializing...
+  // catch definition change or the padding disabling isn't working.
+  assert(sizeof(_traceDatRecord) == 60);
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t parsed_cnt = 0;
+  MappedFile dat_file;
+  if (!dat_file.open(m_fileName)) {
+    // not a regular file (e.g., a pipe), read it record by record instead
+    if (!parse_stream(table, &parsed_cnt))
+      return false;
+  } else {
+    size_t record_cnt = dat_file.size() / sizeof(_traceDatRecord);
+    if (dat_file.size() % sizeof(_traceDatRecord) != 0) {
+      std::cerr << "Ignoring truncated trailing record in " << m_fileName << std::endl;
+    }
+    // The records are packed, so they can be accessed directly in the mapping.
+    if (!decode_records(table, (const _traceDatRecord *) dat_file.data(), record_cnt, NULL))
+      return false;
+    parsed_cnt = record_cnt;
+  }
+
+  if (!parse_constraints(table, NULL))
+    return false;
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Successfully parsed " << parsed_cnt << " trace records from " 
+    << m_fileName << " in " << elapsed.count() << "s (" 
+    << (elapsed.count() > 0 ? parsed_cnt / elapsed.count() : 0) << " records/s)" << std::endl;
+  return true;
 }
 
-bool TraceDatParser::parse(StateCostTable *table)
+bool TraceDatParser::parse_incremental(StateCostTable *table, 
+    std::set<int> *changed_states)
+{
+  MappedFile dat_file;
+  if (!dat_file.open(m_fileName)) {
+    std::cerr << "Unable to open file at " << m_fileName << std::endl;
+    return false;
+  }
+  if (dat_file.size() < m_offset) {
+    std::cerr << m_fileName << " was truncated while following it" << std::endl;
+    return false;
+  }
+  // only consume complete records, the last one may still be being written
+  size_t record_cnt = (dat_file.size() - m_offset) / sizeof(_traceDatRecord);
+  if (!decode_records(table, (const _traceDatRecord *) (dat_file.data() + m_offset), 
+        record_cnt, changed_states))
+    return false;
+  m_offset += record_cnt * sizeof(_traceDatRecord);
+  return parse_constraints(table, changed_states);
+}
+
+bool TraceDatParser::decode_records(StateCostTable *table, 
+    const _traceDatRecord *records, size_t record_cnt, std::set<int> *changed_states)
+{
+  // First pass: count the records of each state so that every trace is
+  // allocated only once.
+  std::vector<size_t> state_cnts;
+  for (size_t i = 0; i < record_cnt; ++i) {
+    int state_id = records[i].state_id;
+    if (!StateCostTable::valid_id(state_id)) {
+      std::cerr << "Invalid state id " << state_id << " in record " << i 
+        << " of " << m_fileName << std::endl;
+      return false;
+    }
+    if ((size_t) state_id >= state_cnts.size())
+      state_cnts.resize(state_id + 1, 0);
+    state_cnts[state_id]++;
+  }
+  table->reserve(state_cnts.size());
+  for (size_t id = 0; id < state_cnts.size(); ++id) {
+    if (state_cnts[id] == 0)
+      continue;
+    StateCostRecord &record = get_state_record(table, id);
+    // when spilling, the traces are only ever partly in memory
+    if (m_spillStore == NULL)
+      record.trace.reserve(record.trace.size() + state_cnts[id]);
+    if (changed_states != NULL)
+      changed_states->insert(id);
+  }
+
+  // Second pass: decode the records. Records of the same state usually come
+  // in runs, so only look up the state record when the state id changes.
+  StateCostRecord *record = NULL;
+  for (size_t i = 0; i < record_cnt; ++i) {
+    const _traceDatRecord &item = records[i];
+    if (record == NULL || record->id != item.state_id)
+      record = &get_state_record(table, item.state_id);
+    // FIXME: write syscall and instr cnt to the trace file and update the state record
+    if (item.acticityId == 0) { // 0x0
+      record->execution_time += item.execution_time;
+    }
+    record->trace.push_back(item.address, item.callerAddress, item.acticityId, 
+        item.parentId, item.execution_time);
+    if ((i + 1) % SPILL_CHECK_INTERVAL == 0 && 
+        !spill_items(table, SPILL_CHECK_INTERVAL))
+      return false;
+  }
+  return spill_items(table, record_cnt % SPILL_CHECK_INTERVAL);
+}
+
+bool TraceDatParser::parse_stream(StateCostTable *table, uint64_t *parsed_cnt)
 {
   // Must open the dat file in binary mode
   std::ifstream dat_file(m_fileName, std::ios::in | std::ios::binary);
-  std::ifstream dat_file2(m_constraintFileName, std::ios::in | std::ios::binary);
-
   if (!dat_file.is_open()) {
     std::cerr << "Unable to open file at " << m_fileName << std::endl;
     return false;
   }
 
-  // do a sanity check on the struct size before deserializing...
-  // catch definition change or the padding disabling isn't working.
-  assert(sizeof(_traceDatRecord) == 60);
-  uint64_t parsed_cnt = 0;
   while (dat_file.good()) {
     struct _traceDatRecord item;
     // read the struct at once. For this to work, the size should be the same
@@ -179,37 +416,77 @@ bool TraceDatParser::parse(StateCostTable *table)
     dat_file.read((char *)&item, sizeof(item));
     if (!dat_file)
       break;
-    parsed_cnt++;
-    // if the struct padding disabling fails, we will need to uncomment the
-    // following and retrieve the field one by one
-
-    // dat_file.read((char *)&item.state_id, sizeof(item.state_id));
-    // dat_file.read((char *)&item.address, sizeof(item.address));
-    // dat_file.read((char *)&item.retAddress, sizeof(item.retAddress));
-    // dat_file.read((char *)&item.callerAddress, sizeof(item.callerAddress));
-    // dat_file.read((char *)&item.execution_time, sizeof(item.execution_time));
-    // dat_file.read((char *)&item.acticityId, sizeof(item.acticityId));
-    // dat_file.read((char *)&item.parentId, sizeof(item.parentId));
-    // dat_file.read((char *)&item.begin, sizeof(item.begin));
-    //
-    // std::cout << "parsed state " << item.state_id << " address 0x" << std::setw(16) << std::setfill('0') << std::hex << item.address << std::endl;
-    
-    // FIXME: write syscall and instr cnt to the trace file and update the state record
+    if (!StateCostTable::valid_id(item.state_id)) {
+      std::cerr << "Invalid state id " << item.state_id << " in record " << *parsed_cnt
+        << " of " << m_fileName << std::endl;
+      return false;
+    }
+    (*parsed_cnt)++;
     FunctionTraceItem trace_item(item.address, item.callerAddress,
         item.acticityId, item.parentId, item.execution_time);
     add_trace_item(table, item.state_id, trace_item);
+    if (*parsed_cnt % SPILL_CHECK_INTERVAL == 0 && 
+        !spill_items(table, SPILL_CHECK_INTERVAL))
+      return false;
   }
   dat_file.close();
+  return spill_items(table, *parsed_cnt % SPILL_CHECK_INTERVAL);
+}
 
-  while(dat_file2.good()) {
+bool TraceDatParser::parse_constraints(StateCostTable *table, 
+    std::set<int> *changed_states)
+{
+  MappedFile dat_file2;
+  const char *data;
+  size_t size;
+  std::string buffer;
+  if (dat_file2.open(m_constraintFileName)) {
+    data = dat_file2.data();
+    size = dat_file2.size();
+  } else {
+    // not a regular file (e.g., a pipe), read it as a stream instead
+    std::ifstream stream(m_constraintFileName, std::ios::in | std::ios::binary);
+    if (!stream.is_open())
+      return true;  // the constraint file is optional
+    std::ostringstream contents;
+    contents << stream.rdbuf();
+    buffer = contents.str();
+    data = buffer.data();
+    size = buffer.size();
+  }
+  if (size < m_constraintOffset) {
+    std::cerr << m_constraintFileName << " was truncated while following it" << std::endl;
+    return false;
+  }
+  size_t item_cnt = (size - m_constraintOffset) / sizeof(ConstraintItem);
+  const char *items = data + m_constraintOffset;
+
+  // count the constraints of each state first to size the lists once
+  std::vector<size_t> state_cnts;
+  for (size_t i = 0; i < item_cnt; ++i) {
     ConstraintItem constraint_item;
+    memcpy(&constraint_item, items + i * sizeof(ConstraintItem), sizeof(ConstraintItem));
+    if (!StateCostTable::valid_id(constraint_item.id)) {
+      std::cerr << "Invalid state id " << constraint_item.id << " in constraint " 
+        << i << " of " << m_constraintFileName << std::endl;
+      return false;
+    }
+    if ((size_t) constraint_item.id >= state_cnts.size())
+      state_cnts.resize(constraint_item.id + 1, 0);
+    state_cnts[constraint_item.id]++;
+  }
+  for (size_t id = 0; id < state_cnts.size(); ++id) {
+    if (state_cnts[id] > 0)
+      get_state_record(table, id).constraints.reserve(state_cnts[id]);
+  }
 
-    dat_file2.read((char *)&constraint_item,sizeof(constraint_item));
-    if (!dat_file2)
-      break;
+  for (size_t i = 0; i < item_cnt; ++i) {
+    ConstraintItem constraint_item;
+    memcpy(&constraint_item, items + i * sizeof(ConstraintItem), sizeof(ConstraintItem));
     add_constraint_item(table,constraint_item);
+    if (changed_states != NULL)
+      changed_states->insert(constraint_item.id);
   }
-
-  std::cout << "Successfully parsed " << parsed_cnt << " trace records from " << m_fileName << std::endl;
+  m_constraintOffset += item_cnt * sizeof(ConstraintItem);
   return true;
 }
@@ -13,7 +13,9 @@
 #define VIOLET_LOG_ANALYZER_PARSER_H
 
 #include <iostream>
+#include <set>
 #include <sstream>
+#include "spill.h"
 #include "trace.h"
 
 // The trace data record that is serialized in the trace file
@@ -34,26 +36,54 @@ struct _traceDatRecord {
 };
 #pragma pack(pop)
 
-typedef struct _constraintRecord {
-  int id;
-  int variable_number;
-  int64_t value;
-  bool is_target;
-} ConstraintItem;
+// How many trace items a parser adds between checks of its spill budget
+#define SPILL_CHECK_INTERVAL (1 << 16)
 
 // The base class for latency trace file parser
 class TraceParserBase {
   protected:
     std::string m_fileName;
     std::string m_constraintFileName;
+    // how far the trace and constraint files have been consumed by
+    // parse_incremental
+    size_t m_offset;
+    size_t m_constraintOffset;
+    // where the traces go when they take more than m_spillBudget bytes
+    TraceSpillStore *m_spillStore;
+    size_t m_spillBudget;
+    size_t m_unspilledItems;
+    bool m_spilled;
+
+    // Count n items just added to the table and evict all traces if the
+    // items added since the last eviction take more than the budget
+    bool spill_items(StateCostTable *table, size_t n);
+    bool spill_traces(StateCostTable *table);
 
   public:
     TraceParserBase(const std::string &fileName, const std::string &constraintFileName):
-      m_fileName(fileName),m_constraintFileName(constraintFileName)
+      m_fileName(fileName),m_constraintFileName(constraintFileName),
+      m_offset(0), m_constraintOffset(0), m_spillStore(NULL), m_spillBudget(0),
+      m_unspilledItems(0), m_spilled(false)
+    {
+    }
+    virtual ~TraceParserBase() { }
+
+    // Evict the traces to store while parsing whenever they take more than
+    // budget bytes, so that the whole table is never in memory
+    void set_spill_store(TraceSpillStore *store, size_t budget)
     {
+      m_spillStore = store;
+      m_spillBudget = budget;
     }
+    // After parse: if any trace was evicted, evict the rest as well, so
+    // that no trace is left partly in memory
+    bool finish_spill(StateCostTable *table);
 
     virtual bool parse(StateCostTable *table) = 0;
+    // Parse the complete records appended to the input since the last call.
+    // The ids of the states that got new records are added to changed_states.
+    virtual bool parse_incremental(StateCostTable *table, std::set<int> *changed_states);
+    static StateCostRecord &get_state_record(StateCostTable *table, int state_id);
     virtual void add_trace_item(StateCostTable *table, int state_id, 
         FunctionTraceItem &item);
     virtual void add_constraint_item(StateCostTable *table, ConstraintItem &item);
@@ -66,23 +96,53 @@ class TraceParserBase {
 // the TraceDatParser
 class TraceLogParser: public TraceParserBase {
   public:
-    TraceLogParser(const std::string &fileName,const std::string constraintFileName):
-      TraceParserBase(fileName,constraintFileName)
+    TraceLogParser(const std::string &fileName,const std::string constraintFileName,
+        int num_threads = 1):
+      TraceParserBase(fileName,constraintFileName), m_numThreads(num_threads)
     {
     }
 
+    // Parse the log. When the log can be memory-mapped, it is split into
+    // chunks at line boundaries that are parsed by m_numThreads workers.
+    // The parsed events are merged in the original log order, so the 
+    // resulting table is the same as the one from a serial parse.
     bool parse(StateCostTable *table);
+    bool parse_incremental(StateCostTable *table, std::set<int> *changed_states);
     
+    // The original stringstream-based field extractors. The parser uses
+    // the allocation-free LogLineScanner instead; these are kept for
+    // comparison in the benchmark.
     static std::string get_address(const std::string &line, std::string name);
     static std::string get_execution_time(const std::string &line, std::string name);
+    static int get_state_id(const std::string &line);
 
   private:
+    // A relevant line in the log, either a test case result with the
+    // instruction and syscall counts of a state or a function trace item
+    struct LogEvent {
+      bool is_case_result;
+      int state_id;
+      int instructions;
+      int syscalls;
+      FunctionTraceItem item;
+    };
+    typedef std::vector<LogEvent> LogEventList;
+
+    int m_numThreads;
+
+    static void parse_line(const char *begin, const char *end, LogEventList &events);
+    static void parse_chunk(const char *begin, const char *end, LogEventList *events);
+    bool parse_range(StateCostTable *table, const char *begin, const char *end,
+        std::set<int> *changed_states);
+    bool parse_window(StateCostTable *table, const char *begin, const char *end,
+        std::set<int> *changed_states);
+    bool apply_events(StateCostTable *table, const LogEventList &events,
+        std::set<int> *changed_states);
+    bool parse_stream(StateCostTable *table);
+
     static size_t get_position(const std::string &filter, const std::string &line);
-    static int get_state_id(const std::string &line);
-    static std::string get_count(const std::string &line, std::string name);
     static std::string get_count_base(const std::string &line, std::string name,
                                char separator);
-    static bool is_case_result(const std::string &line);
 };
 
 // This is the binary latency trace file data parser
@@ -93,7 +153,16 @@ class TraceDatParser: public TraceParserBase {
     {
     }
 
+    // Map the trace file into memory and decode the packed record array
+    // in place. Falls back to parse_stream if the file cannot be mapped.
     bool parse(StateCostTable *table);
+    bool parse_incremental(StateCostTable *table, std::set<int> *changed_states);
+
+  private:
+    bool parse_stream(StateCostTable *table, uint64_t *parsed_cnt);
+    bool decode_records(StateCostTable *table, const _traceDatRecord *records,
+        size_t record_cnt, std::set<int> *changed_states);
+    bool parse_constraints(StateCostTable *table, std::set<int> *changed_states);
 };
 
 #endif /* VIOLET_LOG_ANALYZER_PARSER_H */
@@ -0,0 +1,185 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "scanner.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char STATE_TAG[] = "[State ";
+static const char LATENCY_TAG[] = "LatencyTracker: Function ";
+static const char CASE_TAG[] = "TestCaseGenerator: generating test case at address ";
+
+// The S2E log prefix `elapsed [State N] ` is well within this many bytes
+static const size_t MAX_PREFIX_LEN = 48;
+
+// Both plugin tags are exactly 16 bytes long, one SSE2 register
+static const char LATENCY_PREFIX[] = "LatencyTracker: ";
+static const char CASE_PREFIX[] = "TestCaseGenerato";
+
+static inline bool match_tag16(const char *p, const char *tag)
+{
+#ifdef __SSE2__
+  __m128i line = _mm_loadu_si128((const __m128i *) p);
+  __m128i expected = _mm_loadu_si128((const __m128i *) tag);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(line, expected)) == 0xFFFF;
+#else
+  return memcmp(p, tag, 16) == 0;
+#endif
+}
+
+static inline const char *find_bracket(const char *begin, size_t len)
+{
+  size_t off = 0;
+#ifdef __SSE2__
+  const __m128i bracket = _mm_set1_epi8(']');
+  for (; off + 16 <= len; off += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *) (begin + off));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, bracket));
+    if (mask != 0)
+      return begin + off + __builtin_ctz(mask);
+  }
+#endif
+  for (; off < len; ++off) {
+    if (begin[off] == ']')
+      return begin + off;
+  }
+  return NULL;
+}
+
+LogLineKind LogLineScanner::classify(const char *begin, const char *end)
+{
+  size_t len = end - begin;
+  const char *bracket = find_bracket(begin, len < MAX_PREFIX_LEN ? len : MAX_PREFIX_LEN);
+  if (bracket == NULL)
+    return LOG_LINE_OTHER;
+  const char *tag = bracket + 2;
+  if (end - tag < 16 || bracket[1] != ' ')
+    return LOG_LINE_OTHER;
+  if (match_tag16(tag, LATENCY_PREFIX))
+    return LOG_LINE_LATENCY;
+  if (match_tag16(tag, CASE_PREFIX))
+    return LOG_LINE_CASE;
+  return LOG_LINE_OTHER;
+}
+
+static inline bool is_number_char(char c)
+{
+  return (c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || 
+    c == '+' || c == '-';
+}
+
+bool LogLineScanner::skip_past(const char *token, size_t len)
+{
+  const char *last = end_ - len;
+  for (const char *p = cur_; p <= last; ++p) {
+    p = (const char *) memchr(p, token[0], last - p + 1);
+    if (p == NULL)
+      return false;
+    if (memcmp(p, token, len) == 0) {
+      cur_ = p + len;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LogLineScanner::read_hex(const char *name, size_t len, uint64_t *value)
+{
+  if (!skip_past(name, len))
+    return false;
+  if (end_ - cur_ >= 2 && cur_[0] == '0' && (cur_[1] == 'x' || cur_[1] == 'X'))
+    cur_ += 2;
+  const char *start = cur_;
+  uint64_t v = 0;
+  for (; cur_ < end_; ++cur_) {
+    char c = *cur_;
+    if (c >= '0' && c <= '9')
+      v = (v << 4) | (c - '0');
+    else if (c >= 'a' && c <= 'f')
+      v = (v << 4) | (c - 'a' + 10);
+    else if (c >= 'A' && c <= 'F')
+      v = (v << 4) | (c - 'A' + 10);
+    else
+      break;
+  }
+  *value = v;
+  return cur_ != start;
+}
+
+bool LogLineScanner::read_dec(const char *name, size_t len, uint64_t *value)
+{
+  if (!skip_past(name, len))
+    return false;
+  const char *start = cur_;
+  uint64_t v = 0;
+  for (; cur_ < end_ && *cur_ >= '0' && *cur_ <= '9'; ++cur_)
+    v = v * 10 + (*cur_ - '0');
+  *value = v;
+  return cur_ != start;
+}
+
+bool LogLineScanner::read_double(const char *name, size_t len, double *value)
+{
+  if (!skip_past(name, len))
+    return false;
+  // copy the number to a NUL-terminated stack buffer so that strtod
+  // cannot run past the end of the line
+  char buf[64];
+  size_t n = 0;
+  while (cur_ + n < end_ && n < sizeof(buf) - 1 && is_number_char(cur_[n]))
+    n++;
+  memcpy(buf, cur_, n);
+  buf[n] = '\0';
+  char *stop;
+  *value = strtod(buf, &stop);
+  cur_ += stop - buf;
+  return stop != buf;
+}
+
+bool LogLineScanner::read_state_id(int *state_id)
+{
+  uint64_t id;
+  if (!read_dec(STATE_TAG, LITERAL_LEN(STATE_TAG), &id))
+    return false;
+  // ids that do not fit are left for the parser to reject
+  *state_id = id > INT_MAX ? -1 : (int) id;
+  return true;
+}
+
+bool LogLineScanner::scan_function_line(const char *begin, const char *end,
+    int *state_id, FunctionTraceItem *item)
+{
+  LogLineScanner scanner(begin, end);
+  return scanner.read_state_id(state_id) && 
+    scanner.read_hex(LATENCY_TAG, LITERAL_LEN(LATENCY_TAG), &item->function) &&
+    scanner.read_dec("activityId ", LITERAL_LEN("activityId "), &item->activity_id) &&
+    scanner.read_hex("caller ", LITERAL_LEN("caller "), &item->caller) &&
+    scanner.read_dec("parentId ", LITERAL_LEN("parentId "), &item->parent_id) &&
+    scanner.read_double("runs ", LITERAL_LEN("runs "), &item->execution_time);
+}
+
+bool LogLineScanner::scan_case_line(const char *begin, const char *end,
+    int *state_id, int *instructions, int *syscalls)
+{
+  LogLineScanner scanner(begin, end);
+  uint64_t address, instr_cnt, syscall_cnt;
+  if (!scanner.read_state_id(state_id) ||
+      !scanner.read_hex(CASE_TAG, LITERAL_LEN(CASE_TAG), &address) ||
+      !scanner.read_dec("instruction ", LITERAL_LEN("instruction "), &instr_cnt) ||
+      !scanner.read_dec("syscall ", LITERAL_LEN("syscall "), &syscall_cnt))
+    return false;
+  *instructions = (int) instr_cnt;
+  *syscalls = (int) syscall_cnt;
+  return true;
+}
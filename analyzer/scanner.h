@@ -0,0 +1,64 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_SCANNER_H
+#define VIOLET_LOG_ANALYZER_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "trace.h"
+
+enum LogLineKind {LOG_LINE_OTHER, LOG_LINE_LATENCY, LOG_LINE_CASE};
+
+// A single-pass tokenizer over one line of the S2E log. It works directly
+// on the line buffer (which need not be NUL-terminated) and never 
+// allocates. Each read_* method skips to the named field, decodes its
+// value and leaves the cursor after it, so the fields of a line must be
+// read in the order in which they appear.
+class LogLineScanner {
+  public:
+    LogLineScanner(const char *begin, const char *end): cur_(begin), end_(end) { }
+
+    // Advance the cursor past the next occurrence of token
+    bool skip_past(const char *token, size_t len);
+
+    bool read_hex(const char *name, size_t len, uint64_t *value);
+    bool read_dec(const char *name, size_t len, uint64_t *value);
+    bool read_double(const char *name, size_t len, double *value);
+
+    // Read the N in the `[State N]` tag
+    bool read_state_id(int *state_id);
+
+    // Cheaply classify a line by the plugin tag that follows its 
+    // `[State N] ` prefix. Lines from other plugins are rejected after a
+    // few byte comparisons, before any field is parsed.
+    static LogLineKind classify(const char *begin, const char *end);
+
+    // The LatencyTracker line grammar:
+    // [State N] LatencyTracker: Function 0x..; activityId D; caller 0x..; 
+    //    parentId D; runs Xms;
+    static bool scan_function_line(const char *begin, const char *end,
+        int *state_id, FunctionTraceItem *item);
+
+    // The TestCaseGenerator line grammar:
+    // [State N] TestCaseGenerator: generating test case at address 0x..;
+    //    the number of instruction D; the number of syscall D;
+    static bool scan_case_line(const char *begin, const char *end,
+        int *state_id, int *instructions, int *syscalls);
+
+  private:
+    const char *cur_;
+    const char *end_;
+};
+
+// Length of a string literal without the terminating NUL
+#define LITERAL_LEN(s) (sizeof(s) - 1)
+
+#endif /* VIOLET_LOG_ANALYZER_SCANNER_H */
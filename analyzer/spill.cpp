@@ -0,0 +1,218 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#include "spill.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <iostream>
+
+using namespace std;
+
+TraceSpillStore::TraceSpillStore(): fd_(-1), end_(0), evictions_(0), loads_(0),
+  bytes_written_(0), bytes_read_(0)
+{
+}
+
+TraceSpillStore::~TraceSpillStore()
+{
+  close();
+}
+
+bool TraceSpillStore::open(const string &dir)
+{
+  close();
+  string path = dir + "/violet_trace_spill.XXXXXX";
+  vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+  fd_ = mkstemp(name.data());
+  if (fd_ < 0) {
+    cerr << "Failed to create the scratch file " << path << ": " 
+      << strerror(errno) << endl;
+    return false;
+  }
+  // the file goes away with the descriptor, even if we crash
+  unlink(name.data());
+  end_ = 0;
+  return true;
+}
+
+void TraceSpillStore::close()
+{
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+  slots_.clear();
+}
+
+TraceSpillStore::Slot &TraceSpillStore::slot(const StateCostRecord *record)
+{
+  lock_guard<mutex> lock(mutex_);
+  return slots_[record];
+}
+
+bool TraceSpillStore::is_resident(const StateCostRecord *record)
+{
+  lock_guard<mutex> lock(mutex_);
+  auto it = slots_.find(record);
+  return it == slots_.end() || it->second.resident;
+}
+
+size_t TraceSpillStore::trace_size(const StateCostRecord *record)
+{
+  lock_guard<mutex> lock(mutex_);
+  auto it = slots_.find(record);
+  if (it == slots_.end() || it->second.resident)
+    return record->trace.size();
+  return it->second.size + record->trace.size();
+}
+
+void TraceSpillStore::mark_dirty(const StateCostRecord *record)
+{
+  slot(record).dirty = true;
+}
+
+off_t TraceSpillStore::allocate(size_t len)
+{
+  lock_guard<mutex> lock(mutex_);
+  off_t offset = end_;
+  end_ += len;
+  return offset;
+}
+
+bool TraceSpillStore::write_at(const void *buf, size_t len, off_t offset)
+{
+  {
+    lock_guard<mutex> lock(mutex_);
+    bytes_written_ += len;
+  }
+  const char *p = (const char *) buf;
+  while (len > 0) {
+    ssize_t n = pwrite(fd_, p, len, offset);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      cerr << "Failed to write the scratch file: " << strerror(errno) << endl;
+      return false;
+    }
+    p += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool TraceSpillStore::read_at(void *buf, size_t len, off_t offset)
+{
+  char *p = (char *) buf;
+  while (len > 0) {
+    ssize_t n = pread(fd_, p, len, offset);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      cerr << "Failed to read the scratch file: " << 
+        (n < 0 ? strerror(errno) : "unexpected end of file") << endl;
+      return false;
+    }
+    p += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool TraceSpillStore::evict(StateCostRecord *record)
+{
+  if (fd_ < 0)
+    return false;
+  Slot &s = slot(record);
+  FunctionTrace &trace = record->trace;
+  // the items before first are already in the file; the base columns
+  // never change, so they are only written once
+  size_t first = s.resident ? s.size : 0;
+  assert(first <= trace.size());
+  size_t n = trace.size() - first;
+  if (n > 0) {
+    size_t column = n * sizeof(uint64_t);
+    Extent extent;
+    extent.offset = allocate(5 * column);
+    extent.size = n;
+    if (!write_at(trace.function_.data() + first, column, extent.offset) ||
+        !write_at(trace.caller_.data() + first, column, extent.offset + column) ||
+        !write_at(trace.activity_id_.data() + first, column, extent.offset + 2 * column) ||
+        !write_at(trace.parent_id_.data() + first, column, extent.offset + 3 * column) ||
+        !write_at(trace.execution_time_.data() + first, column, extent.offset + 4 * column))
+      return false;
+    s.extents.push_back(extent);
+    s.size += n;
+  }
+  if (trace.has_diff() && (s.dirty || s.diff_offset < 0)) {
+    // only a fully resident trace has diff latencies
+    assert(s.resident);
+    size_t column = s.size * sizeof(double);
+    if (s.diff_offset < 0)
+      s.diff_offset = allocate(column);
+    if (!write_at(trace.diff_latency_.data(), column, s.diff_offset))
+      return false;
+  }
+  s.dirty = false;
+  s.resident = false;
+  trace.release();
+  lock_guard<mutex> lock(mutex_);
+  evictions_++;
+  return true;
+}
+
+bool TraceSpillStore::load(StateCostRecord *record, const AddressDictionary &functions)
+{
+  if (fd_ < 0)
+    return false;
+  Slot &s = slot(record);
+  if (s.resident)
+    return true;
+  FunctionTrace &trace = record->trace;
+  // the traces are completely evicted once parsing is done
+  assert(trace.empty());
+  size_t n = s.size;
+  trace.function_.resize(n);
+  trace.caller_.resize(n);
+  trace.activity_id_.resize(n);
+  trace.parent_id_.resize(n);
+  trace.execution_time_.resize(n);
+  size_t first = 0;
+  for (auto eit = s.extents.begin(); eit != s.extents.end(); ++eit) {
+    size_t column = eit->size * sizeof(uint64_t);
+    if (!read_at(trace.function_.data() + first, column, eit->offset) ||
+        !read_at(trace.caller_.data() + first, column, eit->offset + column) ||
+        !read_at(trace.activity_id_.data() + first, column, eit->offset + 2 * column) ||
+        !read_at(trace.parent_id_.data() + first, column, eit->offset + 3 * column) ||
+        !read_at(trace.execution_time_.data() + first, column, eit->offset + 4 * column))
+      return false;
+    first += eit->size;
+  }
+  trace.function_id_.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    trace.function_id_[i] = functions.find(trace.function_[i]);
+    assert(trace.function_id_[i] != INVALID_ADDRESS_ID);
+  }
+  if (s.diff_offset >= 0) {
+    trace.diff_latency_.resize(n);
+    if (!read_at(trace.diff_latency_.data(), n * sizeof(double), s.diff_offset))
+      return false;
+  }
+  s.resident = true;
+  lock_guard<mutex> lock(mutex_);
+  loads_++;
+  bytes_read_ += n * (5 * sizeof(uint64_t) + (s.diff_offset >= 0 ? sizeof(double) : 0));
+  return true;
+}
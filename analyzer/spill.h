@@ -0,0 +1,99 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_SPILL_H
+#define VIOLET_LOG_ANALYZER_SPILL_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+#include "trace.h"
+
+// Bytes a trace item takes in memory during the analysis: the five base
+// columns, the function id and the diff latency
+#define SPILL_ITEM_BYTES (5 * sizeof(uint64_t) + sizeof(uint32_t) + sizeof(double))
+
+// Keeps the function traces of states in an unlinked scratch file so that
+// neither parsing nor analyzing a cost table that does not fit in memory
+// needs more than part of the traces at a time. A trace can be evicted
+// while it is still being parsed: the items added since are appended on
+// its next eviction, and loading it reads all of them back. The record
+// metadata and constraints always stay in memory. Records are known by
+// address, which does not change when they are merged into another table.
+// Different records can be evicted from several threads at once.
+class TraceSpillStore {
+  public:
+    TraceSpillStore();
+    ~TraceSpillStore();
+
+    // Create the scratch file in dir
+    bool open(const std::string &dir);
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+
+    // Write the items of record's trace that are not in the scratch file
+    // yet, and its diff latencies if they changed, then free the trace
+    bool evict(StateCostRecord *record);
+    // Read an evicted trace back into record. The function ids, which are
+    // not spilled, are looked up in functions.
+    bool load(StateCostRecord *record, const AddressDictionary &functions);
+    // Whether all items of the trace of record are in memory
+    bool is_resident(const StateCostRecord *record);
+    // Number of items of the trace of record, whether resident or not
+    size_t trace_size(const StateCostRecord *record);
+    // The diff latencies of a resident trace have changed and must be
+    // written back on the next eviction
+    void mark_dirty(const StateCostRecord *record);
+
+    size_t evictions() const { return evictions_; }
+    size_t loads() const { return loads_; }
+    size_t bytes_written() const { return bytes_written_; }
+    size_t bytes_read() const { return bytes_read_; }
+
+  private:
+    TraceSpillStore(const TraceSpillStore &);
+    TraceSpillStore &operator=(const TraceSpillStore &);
+
+    // A run of items written by one eviction, column by column
+    struct Extent {
+      off_t offset;
+      size_t size;
+    };
+
+    struct Slot {
+      bool resident;  // the columns in memory start at the first item
+      bool dirty;
+      size_t size;    // number of trace items in the scratch file
+      std::vector<Extent> extents;
+      off_t diff_offset; // diff latency column, -1 until first written
+
+      Slot(): resident(true), dirty(false), size(0), diff_offset(-1) { }
+    };
+
+    Slot &slot(const StateCostRecord *record);
+    // Reserve len bytes at the end of the file
+    off_t allocate(size_t len);
+    bool write_at(const void *buf, size_t len, off_t offset);
+    bool read_at(void *buf, size_t len, off_t offset);
+
+    int fd_;
+    // guards the slot map, the end of the file and the counters
+    std::mutex mutex_;
+    off_t end_;
+    std::unordered_map<const StateCostRecord *, Slot> slots_;
+    size_t evictions_;
+    size_t loads_;
+    size_t bytes_written_;
+    size_t bytes_read_;
+};
+
+#endif /* VIOLET_LOG_ANALYZER_SPILL_H */
@@ -11,95 +11,753 @@
 
 #include "symtable.h"
 #include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
 #include <iostream>
 #include <fstream>
+#include <cxxabi.h>
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace std;
 
 const char* SYMBOL_TABLE_START = "SYMBOL TABLE:";
-const char* DELIMETERS = " \t";
 
-SymbolTable::SymbolTable()
+// The symbols parsed from one chunk of a symbol file
+struct SymbolChunk {
+  std::vector<struct obj_symbol> symbols;
+  // lines that could not be parsed, numbered from the chunk start
+  std::vector<std::pair<size_t, std::string> > errors;
+  size_t lines;
+
+  SymbolChunk(): lines(0) { }
+};
+
+SymbolTable::SymbolTable(): lazy_names_(false), demangle_(false), load_base_(0), 
+  index_stale_(false)
+{
+  memset(&index_, 0, sizeof(index_));
+}
+
+const std::string &SymbolTable::function_name(struct obj_symbol *symbol)
 {
+  if (symbol->function.empty() && symbol->mangled != NULL) {
+    if (!demangle_) {
+      symbol->function = symbol->mangled;
+      return symbol->function;
+    }
+    int status;
+    char *demangled = abi::__cxa_demangle(symbol->mangled, NULL, NULL, &status);
+    if (status == 0 && demangled != NULL)
+      symbol->function = demangled;
+    else
+      symbol->function = symbol->mangled; // a C symbol
+    free(demangled);
+  }
+  return symbol->function;
 }
 
 void SymbolTable::add_symbol(struct obj_symbol symbol)
 {
+  index_stale_ = true;
   symbols_.push_back(symbol);
-  size_t idx = symbols_.size() - 1;
-  symbol_addr_map_[symbol.address] = idx;
-  symbol_saddr_map_[symbol.saddress] = idx;
-  symbol_func_map_[symbol.function] = idx;
 }
 
 struct obj_symbol* SymbolTable::get_symbol_by_saddr(std::string saddress)
 {
-  auto sit = symbol_saddr_map_.find(saddress);
-  if (sit == symbol_saddr_map_.end())
+  char *end;
+  uint64_t address = strtoull(saddress.c_str(), &end, 16);
+  if (saddress.empty() || *end != '\0')
     return NULL;
-  return &symbols_.at(sit->second);
+  struct obj_symbol *symbol = get_symbol_by_addr(address);
+  if (symbol == NULL)
+    return NULL;
+  if (symbol->saddress.empty() ? hexval(symbol->address).str() != saddress :
+      symbol->saddress != saddress)
+    return NULL;
+  return symbol;
 }
 
 struct obj_symbol* SymbolTable::get_symbol_by_addr(uint64_t address)
 {
-  auto sit = symbol_addr_map_.find(address);
-  if (sit == symbol_addr_map_.end())
+  if (index_stale_)
+    build_index();
+  const uint64_t *starts_end = index_.starts + index_.count;
+  const uint64_t *sit = lower_bound(index_.starts, starts_end, address);
+  if (sit == starts_end || *sit != address)
     return NULL;
-  return &symbols_.at(sit->second);
+  return &symbols_[index_.symbols[sit - index_.starts]];
 }
 
 struct obj_symbol* SymbolTable::get_symbol_by_func(std::string function)
 {
-  auto sit = symbol_func_map_.find(function);
-  if (sit == symbol_func_map_.end())
+  if (index_stale_)
+    build_index();
+  // the symbols with the same hash are in insertion order; like the
+  // other lookups, the last symbol with the name wins
+  uint64_t key = hash<string>()(function);
+  auto range = equal_range(name_index_.begin(), name_index_.end(), 
+      make_pair(key, (uint32_t) 0), [](const pair<uint64_t, uint32_t> &a, 
+        const pair<uint64_t, uint32_t> &b) { return a.first < b.first; });
+  for (auto sit = range.second; sit != range.first; --sit) {
+    if (symbols_[(sit - 1)->second].function == function)
+      return &symbols_[(sit - 1)->second];
+  }
+  if (!lazy_names_)
     return NULL;
-  return &symbols_.at(sit->second);
+  // The mangled name of a C++ function contains its unqualified name,
+  // so only the symbols that contain it need to be demangled
+  string base = function.substr(0, function.find('('));
+  size_t scope = base.rfind("::");
+  if (scope != string::npos)
+    base = base.substr(scope + 2);
+  for (auto it = symbols_.begin(); it != symbols_.end(); ++it) {
+    if (it->mangled != NULL && strstr(it->mangled, base.c_str()) != NULL &&
+        function_name(&*it) == function)
+      return &*it;
+  }
+  return NULL;
 }
 
-bool SymbolTable::parse(string file, SymbolTable* table)
+// Fill the subtree rooted at node k with sorted[i..] in order and return
+// the next unused position of sorted
+static size_t build_eytzinger(const vector<uint64_t> &sorted, size_t i, size_t k,
+    vector<uint64_t> &starts, vector<uint32_t> &ranks)
 {
-    ifstream symfile(file);
-    if (!symfile.is_open()) {
-      return false;
+  if (k < starts.size()) {
+    i = build_eytzinger(sorted, i, 2 * k, starts, ranks);
+    starts[k] = sorted[i];
+    ranks[k] = i++;
+    i = build_eytzinger(sorted, i, 2 * k + 1, starts, ranks);
+  }
+  return i;
+}
+
+void SymbolTable::build_index()
+{
+  // sorting (key, index) pairs keeps the ties in insertion order and 
+  // avoids chasing the symbols in the comparisons
+  vector<pair<uint64_t, uint32_t> > order(symbols_.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = make_pair(symbols_[i].address, i);
+  sort(order.begin(), order.end());
+
+  // Aliases share a start address; the symbol added last wins, but the 
+  // range is the largest of the aliases
+  range_starts_.clear();
+  range_ends_.clear();
+  range_symbols_.clear();
+  for (size_t i = 0; i < order.size(); ++i) {
+    const struct obj_symbol &symbol = symbols_[order[i].second];
+    uint64_t end = symbol.address + (symbol.size ? symbol.size : 1);
+    if (!range_starts_.empty() && range_starts_.back() == symbol.address) {
+      range_ends_.back() = max(range_ends_.back(), end);
+      range_symbols_.back() = order[i].second;
+      continue;
     }
-    string line;
-    long long lineno = 0;
-    bool found_start = false;
-    while (getline(symfile, line)) {
-      lineno++;
-      trim(line);
-      if (line.empty())
-        continue;
-      if (line.compare(SYMBOL_TABLE_START) == 0) {
-        found_start = true;
-        continue;
-      }
-      if (found_start) {
-        vector<string> parts;
-        size_t last_pos;
-        if (!split_untiln(line, DELIMETERS, 5, parts, &last_pos)) {
-          cerr << "unrecognized format in line " << lineno << ": " << line << endl;
-          continue;
-        }
-        if (parts[3].compare(".text") == 0) {
-          // only interested in code symbol
-          struct obj_symbol symbol;
-          ltrim(parts[0], "0");
-          symbol.address = stoll(parts[0], 0, 16);
-          symbol.saddress = "0x" + parts[0];
-          if (last_pos != string::npos) {
-            // find the next non-delimiter char since the last pos
-            last_pos = line.find_first_not_of(DELIMETERS, last_pos);
-            symbol.function = line.substr(last_pos);
-          }
-          table->add_symbol(symbol);
-        }
+    range_starts_.push_back(symbol.address);
+    range_ends_.push_back(end);
+    range_symbols_.push_back(order[i].second);
+  }
+
+  // The ranges still open at the start of each range, innermost last. A
+  // range that overlaps its neighbours without nesting can leave ranges
+  // that are no longer open below the top; resolve skips those.
+  range_parents_.assign(range_starts_.size(), RANGE_NONE);
+  vector<uint32_t> open;
+  for (size_t r = 0; r < range_starts_.size(); ++r) {
+    while (!open.empty() && range_ends_[open.back()] <= range_starts_[r])
+      open.pop_back();
+    if (!open.empty())
+      range_parents_[r] = open.back();
+    open.push_back(r);
+  }
+
+  eytz_starts_.assign(range_starts_.size() + 1, 0);
+  eytz_ranks_.assign(range_starts_.size() + 1, 0);
+  build_eytzinger(range_starts_, 0, 1, eytz_starts_, eytz_ranks_);
+
+  // The names are indexed by hash, so the sort compares integers rather
+  // than long C++ signatures. The names of lazily demangled symbols are
+  // not known yet, those are searched by get_symbol_by_func itself.
+  name_index_.clear();
+  hash<string> hasher;
+  for (size_t i = 0; i < symbols_.size(); ++i) {
+    if (!symbols_[i].function.empty())
+      name_index_.push_back(make_pair(hasher(symbols_[i].function), i));
+  }
+  sort(name_index_.begin(), name_index_.end());
+
+  index_.count = range_starts_.size();
+  index_.starts = range_starts_.data();
+  index_.ends = range_ends_.data();
+  index_.symbols = range_symbols_.data();
+  index_.parents = range_parents_.data();
+  index_.eytz_starts = eytz_starts_.data();
+  index_.eytz_ranks = eytz_ranks_.data();
+  index_stale_ = false;
+}
+
+struct obj_symbol* SymbolTable::resolve(uint64_t pc, uint64_t *offset)
+{
+  if (index_stale_)
+    build_index();
+  size_t n = index_.count;
+  if (n == 0 || pc < load_base_)
+    return NULL;
+  uint64_t address = pc - load_base_;
+  const uint64_t *starts = index_.eytz_starts;
+  // descend to the first start greater than address; the comparison
+  // result picks the child, so there is no branch to mispredict
+  size_t k = 1;
+  while (k <= n)
+    k = 2 * k + (starts[k] <= address);
+  // strip the trailing right turns (and the extra left turn) to get 
+  // back to the node of the answer
+  k >>= __builtin_ffsll(~k);
+  // the enclosing range starts right before the first greater start
+  size_t rank = k == 0 ? n : index_.eytz_ranks[k];
+  if (rank == 0)
+    return NULL;
+  rank--;
+  // past the end of a nested symbol, the address may still be in the
+  // function around it
+  while (address >= index_.ends[rank]) {
+    rank = index_.parents[rank];
+    if (rank == RANGE_NONE)
+      return NULL;
+  }
+  struct obj_symbol *symbol = &symbols_[index_.symbols[rank]];
+  if (offset != NULL)
+    *offset = address - symbol->address;
+  return symbol;
+}
+
+// Find the NT_GNU_BUILD_ID note of an ELF64 file and return it in hex
+static string elf_build_id(const char *data, size_t size)
+{
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *) data;
+  if (size < sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_shentsize != sizeof(Elf64_Shdr) ||
+      ehdr->e_shoff > size || ehdr->e_shnum > (size - ehdr->e_shoff) / sizeof(Elf64_Shdr))
+    return "";
+  const Elf64_Shdr *sections = (const Elf64_Shdr *) (data + ehdr->e_shoff);
+  for (size_t i = 0; i < ehdr->e_shnum; ++i) {
+    const Elf64_Shdr &section = sections[i];
+    if (section.sh_type != SHT_NOTE || section.sh_offset > size || 
+        section.sh_size > size - section.sh_offset)
+      continue;
+    const char *note = data + section.sh_offset;
+    const char *end = note + section.sh_size;
+    while (note + sizeof(Elf64_Nhdr) <= end) {
+      const Elf64_Nhdr *nhdr = (const Elf64_Nhdr *) note;
+      const char *name = note + sizeof(Elf64_Nhdr);
+      const char *desc = name + ((nhdr->n_namesz + 3) & ~3);
+      const char *next = desc + ((nhdr->n_descsz + 3) & ~3);
+      if (next > end || next < note)
+        break;
+      if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && 
+          memcmp(name, "GNU", 4) == 0) {
+        string id;
+        for (size_t j = 0; j < nhdr->n_descsz; ++j)
+          id += hexval((unsigned char) desc[j], 2, false).str();
+        return id;
       }
+      note = next;
     }
-    /*
-    for (auto sit = table->get_symbols().begin(); sit != table->get_symbols().end(); ++sit) {
-      cout << sit->saddress << "|" << sit->function << endl;
+  }
+  return "";
+}
+
+string SymbolTable::cache_key(const string &file)
+{
+  MappedFile mapped;
+  struct stat st;
+  if (stat(file.c_str(), &st) != 0 || !mapped.open(file))
+    return "";
+  string build_id = elf_build_id(mapped.data(), mapped.size());
+  if (!build_id.empty())
+    return "build-id:" + build_id;
+  // FNV-1a over the content, eight bytes at a time
+  uint64_t hash = 14695981039346656037ULL;
+  const char *data = mapped.data();
+  size_t size = mapped.size(), i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * 1099511628211ULL;
+  }
+  for (; i < size; ++i)
+    hash = (hash ^ (unsigned char) data[i]) * 1099511628211ULL;
+  stringstream ss;
+  ss << "hash:" << hexval(hash, 16, false) << ",mtime:" << st.st_mtime 
+    << ",size:" << st.st_size;
+  return ss.str();
+}
+
+string SymbolTable::cache_file_name(const string &file)
+{
+  char *real = realpath(file.c_str(), NULL);
+  string path = real != NULL ? real : file;
+  free(real);
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < path.size(); ++i)
+    hash = (hash ^ (unsigned char) path[i]) * 1099511628211ULL;
+  return path.substr(path.find_last_of('/') + 1) + "." + hexval(hash, 16, false).str() + 
+    ".symcache";
+}
+
+static size_t align8(size_t n)
+{
+  return (n + 7) & ~(size_t) 7;
+}
+
+bool SymbolTable::load_cache(const string &cache_file, const string &key,
+    SymbolTable *table)
+{
+  assert(table->symbols_.empty());
+  MappedFile &cache = table->cache_file_;
+  if (!cache.open(cache_file))
+    return false;
+  const char *data = cache.data();
+  size_t size = cache.size();
+  _symbolCacheHeader header;
+  if (size < sizeof(header)) {
+    cache.close();
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, SYMBOL_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SYMBOL_CACHE_VERSION || header.key_size != key.size() ||
+      sizeof(header) + key.size() > size ||
+      memcmp(data + sizeof(header), key.data(), key.size()) != 0) {
+    cache.close();
+    return false;
+  }
+  size_t n = header.symbol_count;
+  size_t r = header.range_count;
+  size_t l = header.line_count;
+  bool corrupted = n > size / sizeof(uint64_t) || r >= size / sizeof(uint64_t) ||
+    l > size / sizeof(uint64_t) || header.names_size > size || header.file_count > size;
+  size_t addr_offset = sizeof(header) + align8(header.key_size);
+  size_t size_offset = addr_offset + n * sizeof(uint64_t);
+  size_t name_offset = size_offset + n * sizeof(uint64_t);
+  size_t names_offset = align8(name_offset + n * sizeof(uint32_t));
+  size_t starts_offset = names_offset + align8(header.names_size);
+  size_t ends_offset = starts_offset + r * sizeof(uint64_t);
+  size_t eytz_starts_offset = ends_offset + r * sizeof(uint64_t);
+  size_t symbols_offset = eytz_starts_offset + (r + 1) * sizeof(uint64_t);
+  size_t parents_offset = symbols_offset + r * sizeof(uint32_t);
+  size_t eytz_ranks_offset = parents_offset + r * sizeof(uint32_t);
+  size_t line_addr_offset = align8(eytz_ranks_offset + (r + 1) * sizeof(uint32_t));
+  size_t line_offset = line_addr_offset + l * sizeof(uint64_t);
+  size_t files_offset = line_offset + l * sizeof(SourceLine);
+  corrupted = corrupted || files_offset > size || 
+    header.file_names_size != size - files_offset ||
+    (header.names_size > 0 && data[names_offset + header.names_size - 1] != '\0') ||
+    (header.file_names_size > 0 && data[size - 1] != '\0');
+
+  // every part is 8 byte aligned in the file, and so in the mapping
+  RangeIndex index;
+  index.count = r;
+  index.starts = (const uint64_t *) (data + starts_offset);
+  index.ends = (const uint64_t *) (data + ends_offset);
+  index.symbols = (const uint32_t *) (data + symbols_offset);
+  index.parents = (const uint32_t *) (data + parents_offset);
+  index.eytz_starts = (const uint64_t *) (data + eytz_starts_offset);
+  index.eytz_ranks = (const uint32_t *) (data + eytz_ranks_offset);
+  // a bad rank would send resolve out of the arrays or around in circles
+  for (size_t i = 0; i < r && !corrupted; ++i) {
+    corrupted = index.symbols[i] >= n || index.eytz_ranks[i + 1] >= r ||
+      (index.parents[i] != RANGE_NONE && index.parents[i] >= i);
+  }
+  const uint32_t *name_offsets = (const uint32_t *) (data + name_offset);
+  for (size_t i = 0; i < n && !corrupted; ++i)
+    corrupted = name_offsets[i] >= header.names_size;
+  if (corrupted) {
+    cerr << "Corrupted symbol cache " << cache_file << endl;
+    cache.close();
+    return false;
+  }
+
+  vector<uint64_t> line_addresses(l);
+  vector<SourceLine> lines(l);
+  vector<string> file_names;
+  memcpy(line_addresses.data(), data + line_addr_offset, l * sizeof(uint64_t));
+  memcpy(lines.data(), data + line_offset, l * sizeof(SourceLine));
+  for (const char *p = data + files_offset; p < data + size; p += strlen(p) + 1)
+    file_names.push_back(p);
+  corrupted = file_names.size() != header.file_count;
+  for (size_t i = 0; i < l && !corrupted; ++i)
+    corrupted = lines[i].file >= file_names.size() && lines[i].line != 0;
+  if (corrupted) {
+    cerr << "Corrupted symbol cache " << cache_file << endl;
+    cache.close();
+    return false;
+  }
+  table->lines_.assign(line_addresses, lines, file_names);
+
+  // the names stay in the mapping until they are asked for
+  const uint64_t *addresses = (const uint64_t *) (data + addr_offset);
+  const uint64_t *sizes = (const uint64_t *) (data + size_offset);
+  const char *names = data + names_offset;
+  table->symbols_.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    struct obj_symbol &symbol = table->symbols_[i];
+    symbol.address = addresses[i];
+    symbol.size = sizes[i];
+    symbol.mangled = names + name_offsets[i];
+  }
+  table->lazy_names_ = true;
+  table->demangle_ = (header.flags & SYMBOL_CACHE_MANGLED) != 0;
+  table->name_index_.clear();
+  table->index_ = index;
+  table->index_stale_ = false;
+  return true;
+}
+
+static const char padding[8] = {0};
+
+// Write len bytes and pad them to 8 bytes
+static void write_padded(ofstream &out, const void *data, size_t len)
+{
+  out.write((const char *) data, len);
+  out.write(padding, align8(len) - len);
+}
+
+bool SymbolTable::save_cache(const string &cache_file, const string &key)
+{
+  if (index_stale_)
+    build_index();
+  // the names are saved as they were read; demangling them all would 
+  // cost more than the parsing the cache saves
+  size_t n = symbols_.size();
+  vector<uint32_t> name_offsets(n);
+  vector<uint64_t> addresses(n), sizes(n);
+  string names;
+  for (size_t i = 0; i < n; ++i) {
+    const struct obj_symbol &symbol = symbols_[i];
+    addresses[i] = symbol.address;
+    sizes[i] = symbol.size;
+    name_offsets[i] = names.size();
+    if (symbol.mangled != NULL)
+      names += symbol.mangled;
+    else
+      names += symbol.function;
+    names.push_back('\0');
+  }
+
+  _symbolCacheHeader header;
+  memcpy(header.magic, SYMBOL_CACHE_MAGIC, sizeof(header.magic));
+  header.version = SYMBOL_CACHE_VERSION;
+  header.key_size = key.size();
+  header.symbol_count = n;
+  header.names_size = names.size();
+  header.range_count = index_.count;
+  header.flags = demangle_ ? SYMBOL_CACHE_MANGLED : 0;
+  string file_names;
+  for (auto it = lines_.file_names().begin(); it != lines_.file_names().end(); ++it) {
+    file_names += *it;
+    file_names.push_back('\0');
+  }
+  header.line_count = lines_.size();
+  header.file_count = lines_.file_names().size();
+  header.file_names_size = file_names.size();
+
+  // write to a temporary file first so that a concurrent run never sees 
+  // a partial cache; the name is unique to this writer, as paths linked 
+  // to the same file share the cache file
+  static atomic<unsigned> tmp_seq(0);
+  size_t r = index_.count;
+  string tmp_file = cache_file + "." + to_string(getpid()) + "." + 
+    to_string(tmp_seq++) + ".tmp";
+  ofstream out(tmp_file, ios::out | ios::binary | ios::trunc);
+  out.write((const char *) &header, sizeof(header));
+  write_padded(out, key.data(), key.size());
+  out.write((const char *) addresses.data(), n * sizeof(uint64_t));
+  out.write((const char *) sizes.data(), n * sizeof(uint64_t));
+  write_padded(out, name_offsets.data(), n * sizeof(uint32_t));
+  write_padded(out, names.data(), names.size());
+  if (r == 0) {
+    // the Eytzinger arrays still have their unused first entry
+    uint64_t zero = 0;
+    write_padded(out, &zero, sizeof(uint64_t));
+    write_padded(out, &zero, sizeof(uint32_t));
+  } else {
+    out.write((const char *) index_.starts, r * sizeof(uint64_t));
+    out.write((const char *) index_.ends, r * sizeof(uint64_t));
+    out.write((const char *) index_.eytz_starts, (r + 1) * sizeof(uint64_t));
+    out.write((const char *) index_.symbols, r * sizeof(uint32_t));
+    out.write((const char *) index_.parents, r * sizeof(uint32_t));
+    out.write((const char *) index_.eytz_ranks, (r + 1) * sizeof(uint32_t));
+    size_t len = (3 * r + 1) * sizeof(uint32_t);
+    out.write(padding, align8(len) - len);
+  }
+  out.write((const char *) lines_.row_addresses().data(), lines_.size() * sizeof(uint64_t));
+  out.write((const char *) lines_.row_lines().data(), lines_.size() * sizeof(SourceLine));
+  out.write(file_names.data(), file_names.size());
+  out.close();
+  if (!out || rename(tmp_file.c_str(), cache_file.c_str()) != 0) {
+    cerr << "Failed to write the symbol cache " << cache_file << endl;
+    remove(tmp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SymbolTable::parse_elf(string file, SymbolTable* table)
+{
+  MappedFile &elf = table->elf_file_;
+  if (!elf.open(file))
+    return false;
+  const char *data = elf.data();
+  size_t size = elf.size();
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *) data;
+  if (size < sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
+    cerr << file << " is not an ELF64 file" << endl;
+    elf.close();
+    return false;
+  }
+  if (ehdr->e_shentsize != sizeof(Elf64_Shdr) || ehdr->e_shoff > size ||
+      ehdr->e_shnum > (size - ehdr->e_shoff) / sizeof(Elf64_Shdr) ||
+      ehdr->e_shstrndx >= ehdr->e_shnum) {
+    cerr << "Corrupted section headers in " << file << endl;
+    elf.close();
+    return false;
+  }
+  const Elf64_Shdr *sections = (const Elf64_Shdr *) (data + ehdr->e_shoff);
+  size_t section_cnt = ehdr->e_shnum;
+  for (size_t i = 0; i < section_cnt; ++i) {
+    if (sections[i].sh_type != SHT_NOBITS && (sections[i].sh_offset > size ||
+          sections[i].sh_size > size - sections[i].sh_offset)) {
+      cerr << "Section " << i << " is out of bounds in " << file << endl;
+      elf.close();
+      return false;
     }
-    */
+  }
+
+  const Elf64_Shdr *shstrtab = &sections[ehdr->e_shstrndx];
+  size_t text_idx = 0, symtab_idx = 0, dynsym_idx = 0;
+  for (size_t i = 0; i < section_cnt; ++i) {
+    if (sections[i].sh_name < shstrtab->sh_size && strncmp(data + shstrtab->sh_offset + 
+          sections[i].sh_name, ".text", shstrtab->sh_size - sections[i].sh_name) == 0)
+      text_idx = i;
+    if (sections[i].sh_type == SHT_SYMTAB)
+      symtab_idx = i;
+    else if (sections[i].sh_type == SHT_DYNSYM)
+      dynsym_idx = i;
+  }
+  size_t sym_idx = symtab_idx ? symtab_idx : dynsym_idx;
+  if (text_idx == 0 || sym_idx == 0 || sections[sym_idx].sh_link >= section_cnt) {
+    cerr << "No symbol table for .text in " << file << endl;
+    elf.close();
+    return false;
+  }
+
+  const Elf64_Shdr *symtab = &sections[sym_idx];
+  const Elf64_Shdr *strtab = &sections[symtab->sh_link];
+  const Elf64_Sym *syms = (const Elf64_Sym *) (data + symtab->sh_offset);
+  size_t sym_cnt = symtab->sh_size / sizeof(Elf64_Sym);
+  const char *strs = data + strtab->sh_offset;
+  for (size_t i = 0; i < sym_cnt; ++i) {
+    const Elf64_Sym &sym = syms[i];
+    if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_shndx != text_idx || 
+        sym.st_name >= strtab->sh_size)
+      continue;
+    // the name must be terminated inside the string table
+    if (memchr(strs + sym.st_name, '\0', strtab->sh_size - sym.st_name) == NULL)
+      continue;
+    struct obj_symbol symbol;
+    symbol.address = sym.st_value;
+    symbol.size = sym.st_size;
+    symbol.saddress = hexval(sym.st_value).str();
+    symbol.mangled = strs + sym.st_name;
+    table->add_symbol(symbol);
+  }
+  table->lazy_names_ = true;
+  table->demangle_ = true;
+  table->lines_.load(data, size);
+  table->build_index();
+  return true;
+}
+
+static inline int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static bool parse_hex(const char *begin, const char *end, uint64_t *value)
+{
+  uint64_t v = 0;
+  if (begin == end)
+    return false;
+  for (const char *p = begin; p < end; ++p) {
+    int digit = hex_digit(*p);
+    if (digit < 0)
+      return false;
+    v = (v << 4) | digit;
+  }
+  *value = v;
+  return true;
+}
+
+static inline bool is_delimiter(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+// Parse one line of objdump -t output, e.g.,
+//
+//   0000000000a0b1c0 g     F .text	00000000000000a2              handle_query
+//
+// The symbol name is everything after the size column.
+static void parse_symbol_line(const char *begin, const char *end, size_t lineno,
+    SymbolChunk *chunk)
+{
+  while (begin < end && isspace(*begin))
+    begin++;
+  while (end > begin && isspace(end[-1]))
+    end--;
+  if (begin == end)
+    return;
+
+  const char *columns[5], *column_ends[5];
+  int n = 0;
+  const char *p = begin;
+  while (n < 5 && p < end) {
+    columns[n] = p;
+    while (p < end && !is_delimiter(*p))
+      p++;
+    column_ends[n++] = p;
+    while (p < end && is_delimiter(*p))
+      p++;
+  }
+  if (n < 4) {
+    if ((size_t) (end - begin) != strlen(SYMBOL_TABLE_START) ||
+        memcmp(begin, SYMBOL_TABLE_START, end - begin) != 0)
+      chunk->errors.push_back(make_pair(lineno, string(begin, end)));
+    return;
+  }
+  // only interested in code symbol
+  if (n < 5 || column_ends[3] - columns[3] != 5 || memcmp(columns[3], ".text", 5) != 0)
+    return;
+  struct obj_symbol symbol;
+  if (!parse_hex(columns[0], column_ends[0], &symbol.address) ||
+      !parse_hex(columns[4], column_ends[4], &symbol.size)) {
+    chunk->errors.push_back(make_pair(lineno, string(begin, end)));
+    return;
+  }
+  const char *digits = columns[0];
+  while (digits < column_ends[0] - 1 && *digits == '0')
+    digits++;
+  symbol.saddress.reserve(2 + (column_ends[0] - digits));
+  symbol.saddress.append("0x").append(digits, column_ends[0]);
+  symbol.function.assign(p, end);
+  chunk->symbols.push_back(std::move(symbol));
+}
+
+static void parse_symbol_chunk(const char *begin, const char *end, SymbolChunk *chunk)
+{
+  while (begin < end) {
+    const char *nl = (const char *) memchr(begin, '\n', end - begin);
+    if (nl == NULL)
+      nl = end;
+    parse_symbol_line(begin, nl, ++chunk->lines, chunk);
+    begin = nl + 1;
+  }
+}
+
+bool SymbolTable::parse(string file, SymbolTable* table, int num_threads)
+{
+  MappedFile symfile;
+  if (!symfile.open(file)) {
+    return false;
+  }
+  const char *data = symfile.data();
+  const char *data_end = data + symfile.size();
+
+  // the symbols start after the SYMBOL TABLE: line
+  size_t start_len = strlen(SYMBOL_TABLE_START);
+  size_t start_lineno = 0;
+  const char *line = data;
+  bool found_start = false;
+  while (line < data_end && !found_start) {
+    const char *nl = (const char *) memchr(line, '\n', data_end - line);
+    if (nl == NULL)
+      nl = data_end;
+    const char *begin = line, *end = nl;
+    while (begin < end && isspace(*begin))
+      begin++;
+    while (end > begin && isspace(end[-1]))
+      end--;
+    found_start = (size_t) (end - begin) == start_len &&
+      memcmp(begin, SYMBOL_TABLE_START, start_len) == 0;
+    start_lineno++;
+    line = nl < data_end ? nl + 1 : data_end;
+  }
+  if (!found_start)
     return true;
+
+  size_t size = data_end - line;
+  size_t num_chunks = num_threads > 1 ? num_threads : 1;
+  // don't bother splitting small tables
+  if (size < num_chunks * 65536)
+    num_chunks = 1;
+  vector<const char *> bounds;
+  bounds.push_back(line);
+  for (size_t i = 1; i < num_chunks; ++i) {
+    const char *split = line + size / num_chunks * i;
+    if (split < bounds.back())
+      split = bounds.back();
+    const char *nl = (const char *) memchr(split, '\n', data_end - split);
+    bounds.push_back(nl == NULL ? data_end : nl + 1);
+  }
+  bounds.push_back(data_end);
+
+  vector<SymbolChunk> chunks(num_chunks);
+  if (num_chunks == 1) {
+    parse_symbol_chunk(bounds[0], bounds[1], &chunks[0]);
+  } else {
+    vector<thread> workers;
+    for (size_t i = 0; i < num_chunks; ++i) {
+      workers.push_back(thread(parse_symbol_chunk, bounds[i], bounds[i + 1], &chunks[i]));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+      workers[i].join();
+    }
+  }
+
+  size_t total = 0;
+  for (size_t i = 0; i < num_chunks; ++i)
+    total += chunks[i].symbols.size();
+  table->symbols_.reserve(table->symbols_.size() + total);
+  size_t lineno = start_lineno;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    for (auto eit = chunks[i].errors.begin(); eit != chunks[i].errors.end(); ++eit) {
+      cerr << "unrecognized format in line " << lineno + eit->first << ": " 
+        << eit->second << endl;
+    }
+    lineno += chunks[i].lines;
+    for (auto sit = chunks[i].symbols.begin(); sit != chunks[i].symbols.end(); ++sit)
+      table->symbols_.push_back(std::move(*sit));
+    vector<struct obj_symbol>().swap(chunks[i].symbols);
+  }
+  // all lookup indices are built with one sort each instead of inserting
+  // symbol by symbol
+  table->build_index();
+  return true;
 }
@@ -12,15 +12,60 @@
 #define VIOLET_LOG_ANALYZER_SYMTAB_H
 
 #include <string>
-#include <map>
 #include <vector>
 
+#include "dwarf.h"
+#include "utils.h"
+
+// The symbol cache keeps a parsed symbol table in a file that is mapped
+// and used in place. The layout is
+//
+//   header | key | addresses | sizes | name offsets | names |
+//   range starts | range ends | eytzinger starts | range symbols |
+//   range parents | eytzinger ranks | line addresses | lines | file names
+//
+// The symbols are in the order they were added, with their names stored
+// as read (mangled, for a table read from an ELF file) NUL terminated in
+// one blob, so they are demangled only when asked for. The address range
+// index of the table follows; resolve searches it straight in the mapped
+// file. Then come the line table rows, with the file names in a blob of 
+// their own. Each part is padded to 8 bytes. The key identifies the 
+// executable (or symbol file) the cache was built from, see 
+// SymbolTable::cache_key.
+#define SYMBOL_CACHE_MAGIC "VIOLETSC"
+#define SYMBOL_CACHE_VERSION 3
+
+// the names in the cache need demangling
+#define SYMBOL_CACHE_MANGLED 0x1
+
+#pragma pack(push, 1)
+struct _symbolCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t key_size;      // padded to 8 bytes in the file
+  uint64_t symbol_count;
+  uint64_t names_size;
+  uint64_t range_count;
+  uint64_t line_count;
+  uint64_t file_count;
+  uint64_t file_names_size;
+  uint64_t flags;
+};
+#pragma pack(pop)
+
 struct obj_symbol{
   uint64_t address;
-  std::string saddress;
-  std::string function;
+  uint64_t size;
+  std::string saddress;  // empty for symbols loaded from a cache
+  std::string function; // demangled name, see SymbolTable::function_name
+  const char *mangled;  // raw name from an ELF string table or a symbol
+                        // cache, or NULL
+
+  obj_symbol(): address(0), size(0), mangled(NULL) { }
 };
 
+#define RANGE_NONE UINT32_MAX
+
 class SymbolTable {
   public:
     SymbolTable();
@@ -44,13 +89,88 @@ class SymbolTable {
     struct obj_symbol* get_symbol_by_saddr(std::string saddress);
     struct obj_symbol* get_symbol_by_addr(uint64_t address);
     struct obj_symbol* get_symbol_by_func(std::string function);
-    static bool parse(std::string file, SymbolTable* table);
+    // Parse the output of objdump -t, splitting the file among num_threads
+    static bool parse(std::string file, SymbolTable* table, int num_threads = 1);
+    // Read the function symbols in .text straight from the .symtab (or
+    // .dynsym if stripped) of an ELF64 executable
+    static bool parse_elf(std::string file, SymbolTable* table);
+
+    // The key of the symbol cache for file: its GNU build-id for an ELF
+    // file that has one, otherwise a hash of its content, mtime and size.
+    // Empty if file cannot be read.
+    static std::string cache_key(const std::string &file);
+    // The name of the cache file for file: its file name followed by a
+    // hash of its full path, so that files with the same name in 
+    // different directories get caches of their own
+    static std::string cache_file_name(const std::string &file);
+    // Load an empty table from a cache file built with the same key. The
+    // table keeps the file mapped and resolves addresses from it.
+    static bool load_cache(const std::string &cache_file, const std::string &key,
+        SymbolTable *table);
+    bool save_cache(const std::string &cache_file, const std::string &key);
+
+    // The demangled name of symbol. Symbols read from an ELF file or a 
+    // symbol cache are only demangled the first time their name is asked
+    // for.
+    const std::string &function_name(struct obj_symbol *symbol);
+
+    // The address a position independent executable is loaded at. Runtime
+    // addresses are rebased by it before they are resolved.
+    void set_load_base(uint64_t base) { load_base_ = base; }
+    uint64_t load_base() const { return load_base_; }
+
+    // Find the function that contains the runtime address pc and its 
+    // offset into the function. Returns NULL if no function covers pc.
+    struct obj_symbol* resolve(uint64_t pc, uint64_t *offset = NULL);
+
+    // The source lines of the executable read by parse_elf; empty if it
+    // has no DWARF line information. Addresses are link time addresses.
+    const LineTable &lines() const { return lines_; }
+
+    // Build the address range index used by resolve; done lazily
+    // after symbols are added
+    void build_index();
 
   private:
+    // The address range index, either in the vectors filled by
+    // build_index or in the mapped symbol cache. Per sorted rank: the 
+    // range covered, the symbol it belongs to and the rank of an earlier
+    // range that may enclose it (e.g., the function a local symbol is 
+    // nested in), RANGE_NONE if none. The range starts are also kept in 
+    // Eytzinger (BFS) order, 1-based, with the rank of each in the sorted
+    // order. That layout keeps the top levels of the search tree in the
+    // same cache lines and makes the search branch free.
+    struct RangeIndex {
+      size_t count;
+      const uint64_t *starts;
+      const uint64_t *ends;
+      const uint32_t *symbols;
+      const uint32_t *parents;
+      const uint64_t *eytz_starts;  // count + 1 entries
+      const uint32_t *eytz_ranks;
+    };
+
     std::vector<struct obj_symbol> symbols_;
-    std::map<uint64_t, uint64_t> symbol_addr_map_;
-    std::map<std::string, uint64_t> symbol_saddr_map_;
-    std::map<std::string, uint64_t> symbol_func_map_;
+    // the executable whose string table the mangled names point into
+    MappedFile elf_file_;
+    // the symbol cache the names and the range index point into
+    MappedFile cache_file_;
+    // some names are only known through mangled, see function_name
+    bool lazy_names_;
+    // those names need demangling, rather than being final already
+    bool demangle_;
+    LineTable lines_;
+    uint64_t load_base_;
+    bool index_stale_;
+    RangeIndex index_;
+    std::vector<uint64_t> eytz_starts_;
+    std::vector<uint32_t> eytz_ranks_;
+    std::vector<uint64_t> range_starts_;
+    std::vector<uint64_t> range_ends_;
+    std::vector<uint32_t> range_symbols_;
+    std::vector<uint32_t> range_parents_;
+    // (name hash, index) of the symbols with a known name, sorted
+    std::vector<std::pair<uint64_t, uint32_t> > name_index_;
 };
 
 #endif /* VIOLET_LOG_ANALYZER_SYMTAB_H */
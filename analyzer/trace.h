@@ -13,7 +13,10 @@
 #ifndef VIOLET_ANALYZER_TRACE_H
 #define VIOLET_ANALYZER_TRACE_H
 
+#include <assert.h>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <sstream>
 #include "utils.h"
@@ -95,9 +98,179 @@ class FunctionTraceItem {
     }
 };
 
-typedef std::vector<FunctionTraceItem> FunctionTrace;
-typedef std::vector<struct _constraintRecord> ConstraintTrace;
+#define INVALID_ADDRESS_ID ((uint32_t) -1)
 
+// Numbers distinct 64-bit addresses densely from 0, in the order they are
+// first seen
+class AddressDictionary {
+  public:
+    uint32_t intern(uint64_t address)
+    {
+      auto it = index_.find(address);
+      if (it != index_.end())
+        return it->second;
+      uint32_t id = addresses_.size();
+      addresses_.push_back(address);
+      index_[address] = id;
+      return id;
+    }
+
+    // The id of address, or INVALID_ADDRESS_ID if it was never interned
+    uint32_t find(uint64_t address) const
+    {
+      auto it = index_.find(address);
+      return it == index_.end() ? INVALID_ADDRESS_ID : it->second;
+    }
+
+    uint64_t address(uint32_t id) const { return addresses_[id]; }
+    const std::vector<uint64_t> &addresses() const { return addresses_; }
+    size_t size() const { return addresses_.size(); }
+
+    void clear()
+    {
+      addresses_.clear();
+      index_.clear();
+    }
+
+  private:
+    std::vector<uint64_t> addresses_;
+    std::unordered_map<uint64_t, uint32_t> index_;
+};
+
+// The function trace of a state, stored column by column so that scans
+// over a single field (e.g., the parent ids in the critical path search)
+// only touch that field. The diff latency column is only allocated once
+// the trace takes part in a comparison. The function id column holds the
+// id of each function in the function dictionary of the cost table, so
+// that comparisons work on small integers; it is filled in by
+// intern_functions and may lag behind the other columns until then.
+class FunctionTrace {
+  public:
+    size_t size() const { return function_.size(); }
+    bool empty() const { return function_.empty(); }
+
+    void reserve(size_t n)
+    {
+      function_.reserve(n);
+      caller_.reserve(n);
+      activity_id_.reserve(n);
+      parent_id_.reserve(n);
+      execution_time_.reserve(n);
+    }
+
+    void push_back(uint64_t func, uint64_t caller, uint64_t activity,
+        uint64_t parent, double latency)
+    {
+      function_.push_back(func);
+      caller_.push_back(caller);
+      activity_id_.push_back(activity);
+      parent_id_.push_back(parent);
+      execution_time_.push_back(latency);
+      if (!diff_latency_.empty())
+        diff_latency_.push_back(0);
+    }
+
+    void push_back(const FunctionTraceItem &item)
+    {
+      push_back(item.function, item.caller, item.activity_id, item.parent_id,
+          item.execution_time);
+    }
+
+    uint64_t function(size_t i) const { return function_[i]; }
+    uint64_t caller(size_t i) const { return caller_[i]; }
+    uint64_t activity_id(size_t i) const { return activity_id_[i]; }
+    uint64_t parent_id(size_t i) const { return parent_id_[i]; }
+    double execution_time(size_t i) const { return execution_time_[i]; }
+    uint32_t function_id(size_t i) const { return function_id_[i]; }
+    const std::vector<uint32_t> &function_ids() const { return function_id_; }
+    bool has_function_ids() const { return function_id_.size() == size(); }
+
+    // Give the items added since the last call their function ids
+    void intern_functions(AddressDictionary *dict)
+    {
+      function_id_.reserve(size());
+      for (size_t i = function_id_.size(); i < size(); ++i)
+        function_id_.push_back(dict->intern(function_[i]));
+    }
+
+    // Replace every function id by remap[id]
+    void remap_functions(const std::vector<uint32_t> &remap)
+    {
+      for (size_t i = 0; i < function_id_.size(); ++i)
+        function_id_[i] = remap[function_id_[i]];
+    }
+
+    bool has_diff() const { return !diff_latency_.empty(); }
+    double diff_latency(size_t i) const 
+    { 
+      return diff_latency_.empty() ? 0 : diff_latency_[i]; 
+    }
+    void set_diff_latency(size_t i, double latency)
+    {
+      if (diff_latency_.empty())
+        diff_latency_.resize(size(), 0);
+      diff_latency_[i] = latency;
+    }
+    // Swap in a whole diff latency column, one entry per item
+    void swap_diff_latencies(std::vector<double> &latencies)
+    {
+      assert(latencies.size() == size());
+      diff_latency_.swap(latencies);
+    }
+
+    // Materialize the i-th item
+    FunctionTraceItem at(size_t i) const
+    {
+      FunctionTraceItem item(base_item(i));
+      item.diff.latency = diff_latency(i);
+      return item;
+    }
+    // The i-th item without its diff latency; unlike at, it does not read
+    // the diff latency column, which may be replaced by another thread
+    FunctionTraceItem base_item(size_t i) const
+    {
+      return FunctionTraceItem(function_.at(i), caller_[i], activity_id_[i],
+          parent_id_[i], execution_time_[i]);
+    }
+    FunctionTraceItem operator[](size_t i) const { return at(i); }
+
+    // Bytes held by the columns
+    size_t memory_usage() const
+    {
+      return size() * (4 * sizeof(uint64_t) + sizeof(double)) + 
+        function_id_.size() * sizeof(uint32_t) + diff_latency_.size() * sizeof(double);
+    }
+
+    // Free the columns, e.g., after the trace is spilled to disk
+    void release() { *this = FunctionTrace(); }
+
+  private:
+    friend class TraceSpillStore;
+
+    std::vector<uint64_t> function_;
+    std::vector<uint64_t> caller_;
+    std::vector<uint64_t> activity_id_;
+    std::vector<uint64_t> parent_id_;
+    std::vector<double> execution_time_;
+    std::vector<uint32_t> function_id_;
+    std::vector<double> diff_latency_;
+};
+
+// The edit script between two traces: the added and deleted items with
+// their flag and position set
+typedef std::vector<FunctionTraceItem> DiffTrace;
+// The constraint record that is serialized in the constraint file
+typedef struct _constraintRecord {
+  int id;
+  int variable_number;
+  int64_t value;
+  bool is_target;
+} ConstraintItem;
+
+typedef std::vector<ConstraintItem> ConstraintTrace;
+
+// The cost record of a state. Records own the full trace of a state, so
+// they can only be moved, never copied.
 typedef struct StateCostRecord {
   int id;
   int instruction_count;
@@ -106,9 +279,139 @@ typedef struct StateCostRecord {
   FunctionTrace trace;
   ConstraintTrace target_constraints;
   ConstraintTrace constraints;
+
+  explicit StateCostRecord(int id = 0): id(id), instruction_count(0), 
+      syscall_count(0), execution_time(0) { }
+  StateCostRecord(StateCostRecord &&) = default;
+  StateCostRecord &operator=(StateCostRecord &&) = default;
+  StateCostRecord(const StateCostRecord &) = delete;
+  StateCostRecord &operator=(const StateCostRecord &) = delete;
 } StateRecord;
 
-typedef std::map<int, StateCostRecord> StateCostTable;
+// The cost records of all states, indexed directly by the state id. S2E
+// state ids are small dense integers, so lookups are a single array 
+// access, and iteration visits the states in increasing id order. The ids
+// come from the input files, so the parsers reject ids at or above 
+// STATE_ID_LIMIT rather than size the table by a corrupt record.
+#define STATE_ID_LIMIT (1 << 22)
+
+class StateCostTable {
+  public:
+    class iterator {
+      public:
+        iterator(): slots_(NULL), idx_(0) { }
+        iterator(std::vector<std::unique_ptr<StateCostRecord> > *slots, size_t idx):
+          slots_(slots), idx_(idx) { skip_empty(); }
+
+        StateCostRecord &operator*() const { return *(*slots_)[idx_]; }
+        StateCostRecord *operator->() const { return (*slots_)[idx_].get(); }
+        iterator &operator++() { ++idx_; skip_empty(); return *this; }
+        bool operator==(const iterator &rhs) const { return idx_ == rhs.idx_; }
+        bool operator!=(const iterator &rhs) const { return idx_ != rhs.idx_; }
+
+      private:
+        void skip_empty()
+        {
+          while (idx_ < slots_->size() && !(*slots_)[idx_])
+            ++idx_;
+        }
+
+        std::vector<std::unique_ptr<StateCostRecord> > *slots_;
+        size_t idx_;
+    };
+
+    StateCostTable(): size_(0) { }
+
+    iterator begin() { return iterator(&slots_, 0); }
+    iterator end() { return iterator(&slots_, slots_.size()); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    // one past the largest state id in the table
+    size_t id_limit() const { return slots_.size(); }
+
+    static bool valid_id(int64_t id) { return id >= 0 && id < STATE_ID_LIMIT; }
+
+    bool count(int id) const 
+    { 
+      return id >= 0 && (size_t) id < slots_.size() && slots_[id]; 
+    }
+
+    StateCostRecord *find(int id)
+    {
+      return count(id) ? slots_[id].get() : NULL;
+    }
+
+    // Get the record of a state, creating an empty one if it is missing
+    StateCostRecord &operator[](int id)
+    {
+      assert(valid_id(id));
+      if ((size_t) id >= slots_.size())
+        slots_.resize(id + 1);
+      if (!slots_[id]) {
+        slots_[id].reset(new StateCostRecord(id));
+        size_++;
+      }
+      return *slots_[id];
+    }
+
+    // Make room for the ids below id_limit
+    void reserve(size_t id_limit)
+    {
+      if (id_limit > slots_.size())
+        slots_.resize(id_limit);
+    }
+
+    // The dictionary of the functions in all traces of the table
+    const AddressDictionary &functions() const { return functions_; }
+
+    // Intern the functions of the trace items that have no id yet
+    void intern_functions()
+    {
+      for (auto it = slots_.begin(); it != slots_.end(); ++it) {
+        if (*it && !(*it)->trace.has_function_ids())
+          (*it)->trace.intern_functions(&functions_);
+      }
+    }
+
+    // Move all records of other into this table, renumbering each state
+    // id to id + id_offset. The shifted ids must not be in use. Function
+    // ids already given in other are translated to this table's.
+    void merge(StateCostTable &other, int id_offset)
+    {
+      std::vector<uint32_t> remap(other.functions_.size());
+      bool identity = true;
+      for (uint32_t id = 0; id < remap.size(); ++id) {
+        remap[id] = functions_.intern(other.functions_.address(id));
+        identity = identity && remap[id] == id;
+      }
+      reserve(other.id_limit() + id_offset);
+      for (size_t id = 0; id < other.slots_.size(); ++id) {
+        std::unique_ptr<StateCostRecord> &record = other.slots_[id];
+        if (!record)
+          continue;
+        int new_id = id + id_offset;
+        assert(!slots_[new_id]);
+        record->id = new_id;
+        for (auto cit = record->constraints.begin(); cit != record->constraints.end(); ++cit)
+          cit->id = new_id;
+        for (auto cit = record->target_constraints.begin(); 
+            cit != record->target_constraints.end(); ++cit)
+          cit->id = new_id;
+        if (!identity)
+          record->trace.remap_functions(remap);
+        slots_[new_id] = std::move(record);
+        size_++;
+      }
+      other.slots_.clear();
+      other.size_ = 0;
+      other.functions_.clear();
+    }
+
+  private:
+    std::vector<std::unique_ptr<StateCostRecord> > slots_;
+    size_t size_;
+    AddressDictionary functions_;
+};
 typedef std::string BlackList;
 
 #endif /* VIOLET_ANALYZER_TRACE_H */
@@ -12,8 +12,53 @@
 
 #include "utils.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace std;
 
+bool MappedFile::open(const string &path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  const char *data = NULL;
+  if (size > 0) {
+    void *addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+    // the mapped files are scanned front to back
+    madvise(addr, size, MADV_SEQUENTIAL);
+    data = (const char *) addr;
+  }
+  fd_ = fd;
+  data_ = data;
+  size_ = size;
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (data_ != NULL)
+    munmap((void *) data_, size_);
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+  data_ = NULL;
+  size_ = 0;
+}
+
 void split(const string& str, const char *delimeters, vector<string>& result)
 {
   char* token = strtok(const_cast<char *>(str.c_str()), delimeters);
@@ -76,6 +76,29 @@ inline std::string& trim(std::string& str) {
   return ltrim(rtrim(str));
 }
 
+// A read-only memory mapping of a whole file. The mapping is released
+// when the object goes out of scope.
+class MappedFile {
+  public:
+    MappedFile(): fd_(-1), data_(NULL), size_(0) { }
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path);
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+  private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    int fd_;
+    const char *data_;
+    size_t size_;
+};
+
 void split(const std::string& str, const char *delimeters, std::vector<std::string>& result);
 bool split_untiln(const std::string& str, const char *delimeters, int n, 
     std::vector<std::string>& result, size_t *last_pos);
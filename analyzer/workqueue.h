@@ -0,0 +1,76 @@
+//
+// The Violet Project
+//
+// Copyright (c) 2019, Johns Hopkins University - Order Lab.
+//
+//    All rights reserved.
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//
+
+#ifndef VIOLET_LOG_ANALYZER_WORKQUEUE_H
+#define VIOLET_LOG_ANALYZER_WORKQUEUE_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// The tasks 0 to n-1 spread over the deques of a number of workers. The
+// tasks are dealt round-robin, so that each worker, taking tasks from the
+// front of its own deque, works on low task numbers first; a worker whose
+// deque is empty steals from the back of the fullest other deque. Tasks
+// are coarse (a state pair each), so a lock per deque is cheap enough.
+class WorkStealingQueue {
+  public:
+    WorkStealingQueue(size_t n, size_t workers): deques_(workers)
+    {
+      for (size_t w = 0; w < workers; ++w)
+        deques_[w].reset(new WorkerDeque());
+      for (size_t task = 0; task < n; ++task)
+        deques_[task % workers]->tasks.push_back(task);
+    }
+
+    // Take the next task of worker; returns false once all tasks are taken
+    bool pop(size_t worker, size_t *task)
+    {
+      {
+        WorkerDeque &own = *deques_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+          *task = own.tasks.front();
+          own.tasks.pop_front();
+          return true;
+        }
+      }
+      while (true) {
+        size_t victim = deques_.size(), most = 0;
+        for (size_t w = 0; w < deques_.size(); ++w) {
+          std::lock_guard<std::mutex> lock(deques_[w]->mutex);
+          if (deques_[w]->tasks.size() > most) {
+            most = deques_[w]->tasks.size();
+            victim = w;
+          }
+        }
+        if (victim == deques_.size())
+          return false;
+        WorkerDeque &other = *deques_[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        // it may have been emptied since it was looked at
+        if (!other.tasks.empty()) {
+          *task = other.tasks.back();
+          other.tasks.pop_back();
+          return true;
+        }
+      }
+    }
+
+  private:
+    struct WorkerDeque {
+      std::mutex mutex;
+      std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerDeque> > deques_;
+};
+
+#endif /* VIOLET_LOG_ANALYZER_WORKQUEUE_H */